@@ -0,0 +1,236 @@
+// bench.hpp
+// Microbenchmarks of the engine kernels on the board of a domain
+// (--bench=FILE, make bench).
+
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <future>
+#include <algorithm>
+
+/*
+ * Each kernel is run by batches of growing size until a batch takes at
+ * least --bench-time seconds, its time per operation is the one of the
+ * last batch.
+ *
+ * The policy kernels replay a realistic stream of codes: the legal move
+ * codes seen by the playouts of a short level 1 search, in the order of
+ * their lookups, with the policy learnt by this search. playout uses
+ * this policy, updatePolicy and LegalMoves copy use the best rollout of
+ * the search (updatePolicy on its prefixes of several lengths).
+ *
+ * Results are written to FILE ("-" = stdout) as JSON, or as CSV if FILE
+ * ends with .csv, one record per kernel:
+ *   name, param, iterations, seconds, ns_per_op, ops_per_second
+ * --tag is copied in the output, e.g. to record the commit.
+ */
+template <typename B, typename M, int L, int PL, int LM>
+class Bench{
+
+public:
+
+  typedef Nrpa<B,M,L,PL,LM> N;
+  typedef typename N::LocalBest LocalBest;
+
+  static const int NB_LEARN = 100;         // playouts of the learning search
+  static const int MAX_STREAM = 1 << 20;   // codes of the stream
+
+  struct Result{
+    std::string name;
+    std::string param;
+    long iterations;
+    double seconds;
+  };
+
+  static void run(const Options &o){
+    using namespace std;
+    errorif(o.benchTime <= 0, "bench time should be positive.");
+
+    /* Learning search: the stream of codes, the policy and the best rollout */
+    unique_ptr<Policy> policy(new Policy);
+    unique_ptr<LocalBest> best(new LocalBest), current(new LocalBest);
+    best->bestRollout.reset();
+    best->legalMoveCodes.setNbSteps(0);
+    vector<int> stream;
+    long nbSteps = 0;
+    for(int i = 0; i < NB_LEARN; i++){
+      N::playout(*policy, current->bestRollout, current->legalMoveCodes);
+      nbSteps += current->bestRollout.length();
+      for(int step = 0; step < current->bestRollout.length(); step++)
+	for(int k = 0; k < current->legalMoveCodes.nbMoves(step) && (int)stream.size() < MAX_STREAM; k++)
+	  stream.push_back(current->legalMoveCodes.move(step, k));
+      if(current->bestRollout.score() >= best->bestRollout.score()){
+	best->bestRollout = current->bestRollout;
+	best->legalMoveCodes = current->legalMoveCodes;
+      }
+      N::updatePolicy(*policy, best->bestRollout, best->legalMoveCodes);
+    }
+    errorif(stream.empty(), "the playouts of the domain have no legal moves.");
+
+    vector<Result> results;
+    double minTime = o.benchTime;
+    size_t size = stream.size();
+    unique_ptr<Policy> scratch(new Policy(*policy));
+
+    ostringstream codes;
+    codes<<"codes="<<size;
+    results.push_back(measure("policy.prob", codes.str(), minTime, [&](long n){
+	  double s = 0;
+	  for(long k = 0, i = 0; k < n; k++, i = i + 1 == (long)size ? 0 : i + 1)
+	    s += policy->prob(stream[i]);
+	  return s;
+	}));
+    results.push_back(measure("policy.setProb", codes.str(), minTime, [&](long n){
+	  for(long k = 0, i = 0; k < n; k++, i = i + 1 == (long)size ? 0 : i + 1)
+	    scratch->setProb(stream[i], 0.5);
+	  return 0.;
+	}));
+    results.push_back(measure("policy.updateProb", codes.str(), minTime, [&](long n){
+	  for(long k = 0, i = 0; k < n; k++, i = i + 1 == (long)size ? 0 : i + 1)
+	    scratch->updateProb(stream[i], k & 1 ? 1e-3 : -1e-3);
+	  return 0.;
+	}));
+
+    ostringstream steps;
+    steps<<"steps="<<fixed<<setprecision(1)<<(double)nbSteps / NB_LEARN;
+    results.push_back(measure("playout", steps.str(), minTime, [&](long n){
+	  double s = 0;
+	  for(long k = 0; k < n; k++)
+	    s += N::playout(*policy, current->bestRollout, current->legalMoveCodes);
+	  return s;
+	}));
+
+    /* updatePolicy on prefixes of the best rollout, with alternate signs
+       so that the weights stay bounded */
+    int length = best->bestRollout.length();
+    vector<int> lengths;
+    for(int l = 1; l < length; l *= 10) lengths.push_back(l);
+    if(length > 0) lengths.push_back(length);
+    for(size_t j = 0; j < lengths.size(); j++){
+      unique_ptr<Rollout<PL>> prefix(new Rollout<PL>);
+      prefix->reset();
+      for(int step = 0; step < lengths[j]; step++) prefix->addMove(best->bestRollout.move(step));
+      *scratch = *policy;
+      ostringstream param;
+      param<<"length="<<lengths[j];
+      results.push_back(measure("updatePolicy", param.str(), minTime, [&](long n){
+	    for(long k = 0; k < n; k++)
+	      N::updatePolicy(*scratch, *prefix, best->legalMoveCodes, k & 1 ? N::ALPHA : -N::ALPHA);
+	    return 0.;
+	  }));
+    }
+
+    ostringstream copied;
+    copied<<"steps="<<length;
+    results.push_back(measure("LegalMoves.copy", copied.str(), minTime, [&](long n){
+	  for(long k = 0; k < n; k++)
+	    current->legalMoveCodes = best->legalMoveCodes;
+	  return 0.;
+	}));
+
+    /* Thread pool: round trip of one empty task, and empty tasks
+       submitted by groups of 64 */
+    ThreadPool &pool = globalThreadPool();
+    if(! pool.initialized())
+      pool.init(max(1, (o.numThread > 0 ? o.numThread : ThreadPool::availableCpus()) - 1), o.threadStats);
+    int nbWorkers = pool.enter();
+    ostringstream workers;
+    workers<<"workers="<<nbWorkers;
+    if(nbWorkers > 0){
+      results.push_back(measure("ThreadPool.submit-latency", workers.str(), minTime, [&](long n){
+	    for(long k = 0; k < n; k++)
+	      pool.submit([]() -> int { return 0; }).get();
+	    return 0.;
+	  }));
+      results.push_back(measure("ThreadPool.submit-throughput", workers.str(), minTime, [&](long n){
+	    vector<future<int>> done;
+	    for(long k = 0; k < n; k += 64){
+	      done.clear();
+	      for(long t = k; t < min(n, k + 64); t++)
+		done.push_back(pool.submit([]() -> int { return 0; }));
+	      for(size_t t = 0; t < done.size(); t++) done[t].wait();
+	    }
+	    return 0.;
+	  }));
+    }
+    pool.leave();
+
+    if(o.bench == "-")
+      write(cout, false, o, results);
+    else{
+      ofstream ofs(o.bench);
+      errorif(!ofs, "cannot write benchmark file " + o.bench + ".");
+      bool csv = o.bench.size() >= 4 && o.bench.compare(o.bench.size() - 4, 4, ".csv") == 0;
+      write(ofs, csv, o, results);
+      cout<<"Benchmark filename: "<<o.bench<<endl;
+    }
+  }
+
+private:
+
+  template <typename F>
+  static Result measure(const std::string &name, const std::string &param, double minTime, F f){
+    using namespace std::chrono;
+    volatile double sink;
+    Result r;
+    r.name = name;
+    r.param = param;
+    for(long n = 1; ; ){
+      steady_clock::time_point start = steady_clock::now();
+      sink = f(n);
+      double seconds = duration<double>(steady_clock::now() - start).count();
+      if(seconds >= minTime || n >= (1L << 40)){
+	r.iterations = n;
+	r.seconds = seconds;
+	break;
+      }
+      n *= seconds < minTime / 10 ? 10 : 2;
+    }
+    (void)sink;
+    std::cerr<<"  "<<name<<" ("<<param<<"): "<<1e9 * r.seconds / r.iterations<<" ns"<<std::endl;
+    return r;
+  }
+
+  static void write(std::ostream &os, bool csv, const Options &o, const std::vector<Result> &results){
+    os<<std::setprecision(6);
+    if(csv){
+      os<<"name,param,iterations,seconds,ns_per_op,ops_per_second"<<"\n";
+      for(size_t i = 0; i < results.size(); i++){
+	const Result &r = results[i];
+	os<<r.name<<","<<r.param<<","<<r.iterations<<","<<r.seconds<<","
+	  <<1e9 * r.seconds / r.iterations<<","<<r.iterations / r.seconds<<"\n";
+      }
+      return;
+    }
+    os<<"{\n";
+    os<<"  \"tag\": \""<<o.tag<<"\",\n";
+    os<<"  \"L\": "<<L<<", \"PL\": "<<PL<<", \"LM\": "<<LM<<",\n";
+    os<<"  \"bench_time\": "<<o.benchTime<<",\n";
+    os<<"  \"results\": [\n";
+    for(size_t i = 0; i < results.size(); i++){
+      const Result &r = results[i];
+      os<<"    {\"name\": \""<<r.name<<"\", \"param\": \""<<r.param<<"\", \"iterations\": "<<r.iterations
+	<<", \"seconds\": "<<r.seconds<<", \"ns_per_op\": "<<1e9 * r.seconds / r.iterations
+	<<", \"ops_per_second\": "<<r.iterations / r.seconds<<"}"<<(i + 1 < results.size() ? "," : "")<<"\n";
+    }
+    os<<"  ]\n";
+    os<<"}\n";
+  }
+
+  static void errorif(bool cond, const std::string &msg){
+    if(cond){
+      std::cerr<<"Error : "<<msg<<std::endl;
+      exit(1);
+    }
+  }
+};
+
+#endif //BENCH_HPP
@@ -0,0 +1,137 @@
+#!/bin/bash
+# bench_strats.sh
+# Compare parallelization strategies on time-to-score.
+#
+# Each strategy is run with iteration statistics enabled (-s), then the
+# iteration stats file is used to compute, for each run, the first time
+# at which the best score reaches the target score.
+#
+# Usage: see ./bench_strats.sh (without any argument).
+#
+
+usage () {
+cat << EOS
+./bench_strats.sh [-s "<strategies>"] [-t <target>] [-r <ref> [-e <tolerance>]] [-c <dir>] <binary> <standard_nrpa_arguments>
+ Where:
+    -s "<strategies>" is the list of strategies to compare (default: "1 2 3 4").
+
+    -t <target> is the score to reach. By default, the lowest average
+    final score among all strategies is used, so that every strategy
+    has a chance to reach it.
+
+    -r <ref> turns this script into a quality test: it fails if the
+    average final score of any strategy is lower than the one of
+    strategy <ref> by more than <tolerance> percent (default: 10).
+
+    -c <dir> keeps the average score curve of each strategy in
+    <dir>/strat<N>.dat (<iterId> <avgtimestamp> <avgscore> ..., see
+    plots/avg.sh), ready to be plotted with gnuplot.
+
+    <binary> is any nrpa executable (e.g. ./same or test/tsptw).
+
+    <standard_nrpa_arguments> can be any argument supported by nrpa,
+    except --parallel-strat (-P), --iter-stats (-s), --tag (-T) and
+    --statfile-prefix (-f) which are set by this script.
+EOS
+}
+
+STRATS="1 2 3 4"
+TARGET=""
+REF=""
+TOLERANCE=10
+CURVES=""
+
+while [[ "$1" == \-* ]]; do
+    case $1 in
+	-s ) shift
+	     STRATS=$1
+	     ;;
+	-t ) shift
+	     TARGET=$1
+	     ;;
+	-r ) shift
+	     REF=$1
+	     ;;
+	-e ) shift
+	     TOLERANCE=$1
+	     ;;
+	-c ) shift
+	     CURVES=$1
+	     ;;
+	* )  usage
+	     exit 1
+	     ;;
+    esac
+    shift
+done
+
+if [ $# -lt 1 ]; then
+    usage;
+    exit 1;
+fi
+
+BIN=$1
+shift
+REST=$*
+
+if [ ! -z "$REF" ] && [[ " $STRATS " != *" $REF "* ]]; then
+    STRATS="$REF $STRATS"
+fi
+
+PREFIX=$(mktemp -d)/nrpa_stats
+declare -A STATFILE
+
+for s in $STRATS; do
+    echo "Running $BIN $REST -P $s -s -f $PREFIX -T strat$s" >&2
+    STATFILE[$s]=$($BIN $REST -P $s -s -f $PREFIX -T strat$s | grep "Iter stats filename" | head -n 1 | cut -d ':' -f 2 | tr -d ' ')
+    if [ -z "${STATFILE[$s]}" ] || [ ! -f "${STATFILE[$s]}" ]; then
+	echo "Error: no iteration statistics for strategy $s." >&2
+	exit 1
+    fi
+done
+
+# average final score of a stat file
+final_score () {
+    awk '/^[^#]/ && NF >= 4 { last[$1] = $4 }
+         END { for(r in last) { sum += last[r]; n++ } if(n > 0) print sum / n }' $1
+}
+
+if [ -z "$TARGET" ]; then
+    TARGET=$(for s in $STRATS; do final_score ${STATFILE[$s]}; done | sort -g | head -n 1)
+fi
+
+echo "# target score: $TARGET"
+echo "#<strategy> <avgfinalscore> <nbrunsreachingtarget>/<nbruns> <avgtimetotarget>"
+for s in $STRATS; do
+    awk -v target=$TARGET -v strat=$s \
+	'/^[^#]/ && NF >= 4 { runs[$1] = 1; last[$1] = $4;
+                              if(!($1 in reached) && $4 >= target) reached[$1] = $3 }
+         END { for(r in runs) { n++; sum += last[r] }
+               for(r in reached) { k++; tsum += reached[r] }
+               printf "%s %.2f %d/%d %s\n", strat, sum / n, k, n, (k > 0 ? sprintf("%.2f", tsum / k) : "-") }' ${STATFILE[$s]}
+done
+
+if [ ! -z "$CURVES" ]; then
+    mkdir -p $CURVES
+    for s in $STRATS; do
+	$(dirname $0)/plots/avg.sh ${STATFILE[$s]} | sort -n > $CURVES/strat$s.dat
+    done
+    echo "# curves written in $CURVES"
+fi
+
+RES=0
+if [ ! -z "$REF" ]; then
+    REFSCORE=$(final_score ${STATFILE[$REF]})
+    for s in $STRATS; do
+	f=$(final_score ${STATFILE[$s]})
+	if awk -v f=$f -v r=$REFSCORE -v t=$TOLERANCE 'BEGIN { a = (r < 0 ? -r : r); exit !(f < r - a * t / 100) }'; then
+	    echo "$0: strategy $s: FAILURE (average score $f, strategy $REF: $REFSCORE, tolerance $TOLERANCE%)."
+	    RES=1
+	else
+	    echo "$0: strategy $s: SUCCESS (average score $f, strategy $REF: $REFSCORE, tolerance $TOLERANCE%)."
+	fi
+    done
+fi
+
+rm -rf $(dirname $PREFIX)
+exit $RES
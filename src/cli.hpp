@@ -8,6 +8,8 @@
 #include <iostream>
 #include <unistd.h> //GETOPT
 #include <getopt.h>
+#include <sstream>
+#include <vector>
 
 extern char *optarg;
 extern int optind, opterr, optopt;
@@ -27,14 +29,42 @@ struct Options{
   std::string tag = ""; // name for this run, will be used to generate trace data file 
   int parallelLevel = 1; 
   int parStrat = 1; 
+  int staleness = -1; // max policy versions a result may lag behind (strategy 4 only)
+  int overDecomp = 1; // sub-searches per thread and per round (strategy 1 only)
+  int mergePeriod = 1; // thread-local policies are averaged every mergePeriod iterations (strategy 6 only)
+  bool autoParallel = false; 
+  int concurrentRuns = 1; 
+  std::string portfolio = ""; // ';' separated configurations, each one a list of options (see withArgs)
+  bool portfolioPolicy = false; 
+  bool beam = false; 
+  int beamSize = 0; // 0 = SizeBeam[level] (set by the game)
+  std::string algo = "nrpa"; // search engine: nrpa or nmcs
+  int batchSize = 1; // level 1 playouts run under the same policy
+  std::string metricsFile = ""; // Prometheus text file, rewritten every metricsPeriod seconds
+  double metricsPeriod = 1; 
+  std::string statsStream = ""; // append statistics events to this file as they happen
+  bool statsStreamBinary = false; 
+  std::string traceFile = ""; // Chrome trace of the threads, written at the end
+  int traceSize = 1 << 16; // events kept per thread
+  bool perfCounters = false; // hardware counters of the search threads
+  std::string memLimit = "0"; // size with an optional K, M or G suffix, 0 = no limit
+  bool memReport = false; 
+  std::string bench = ""; // run the microbenchmarks instead of the test, write the results to this file
+  double benchTime = 0.2; // minimum duration of each benchmark, in seconds
   bool threadStats = false; 
   int seed = -1; 
   
   static void usage(const std::string &binName, std::ostream &os = std::cerr); 
   static Options parse(int &argc, char **&argv, bool exitOnError = true); 
+  /* Copy of these options, updated with the options listed in args (e.g. "-P 3 -l 2") */ 
+  Options withArgs(const std::string &args) const; 
   void print(std::ostream &os = std::cout, const std::string &prefix = "") const; 
   void printAll(std::ostream &os = std::cout, const std::string &prefix = "") const; 
 
+private:
+  /* Read options from argv, return true if the parse-option-only flag was found */ 
+  bool update(int argc, char **argv, bool exitOnError); 
+
 }; 
 
 
@@ -55,7 +85,7 @@ inline void Options::usage(const std::string &binName, std::ostream &os) {
     << "\t\tNrpa depth (default: "<<d.numLevel<<").\n"
 
     << "\t--num-thread=NUM, -x NUM\n"
-    << "\t\tNumber of threads (0 = hardware capacity, default: "<<d.numThread<<").\n"
+    << "\t\tNumber of threads (0 = cpus available to the process, default: "<<d.numThread<<").\n"
 
     << "\t--timeout=NUM, -t NUM\n"
     << "\t\tTimeout in sec. for a single run (0 = no timeout, default: "<<d.timeout<<").\n"
@@ -78,6 +108,72 @@ inline void Options::usage(const std::string &binName, std::ostream &os) {
     << "\t--parallel-strat=NUM, -P NUM\n"
     << "\t\tUse parallelization strategy number N (default: "<<d.parStrat<<").\n"
 
+    << "\t--over-decomp=NUM, -d NUM\n"
+    << "\t\tWith strategy 1, run NUM sub-searches per thread in each round, threads claim them dynamically (default: "<<d.overDecomp<<").\n"
+
+    << "\t--staleness=NUM, -k NUM\n"
+    << "\t\tWith strategy 4, drop results computed on a policy more than NUM versions old (-1 = no bound, default: "<<d.staleness<<").\n"
+
+    << "\t--merge-period=NUM, -m NUM\n"
+    << "\t\tWith strategy 6, average thread-local policies every NUM iterations (default: "<<d.mergePeriod<<").\n"
+
+    << "\t--auto-parallel, -A\n"
+    << "\t\tStart with strategy 1 and adapt the parallel level and strategy during the first iterations (default: "<<yesnostring(d.autoParallel)<<").\n"
+
+    << "\t--concurrent-runs=NUM, -K NUM\n"
+    << "\t\tMake NUM runs at the same time, each with a share of the threads. Run i draws from the seed stream seed + i instead of the stream of sequential runs, so scores differ from the ones of -K 1, and are reproducible only with one thread per run (pool workers have their own streams) (default: "<<d.concurrentRuns<<").\n"
+
+    << "\t--portfolio=STRING, -F STRING\n"
+    << "\t\tRun several configurations at the same time, sharing their best rollout. STRING is a ';' separated list of option lists, e.g. \"-P 1 -l 3; -P 3 -l 2 -n 20\" (default: None).\n"
+
+    << "\t--portfolio-policy, -W\n"
+    << "\t\tIn portfolio mode, a configuration that takes the shared best rollout also takes the policy that produced it (default: "<<yesnostring(d.portfolioPolicy)<<").\n"
+
+    << "\t--beam, -B\n"
+    << "\t\tRun Beam NRPA: each level keeps several rollouts, each with its own policy (default: "<<yesnostring(d.beam)<<").\n"
+
+    << "\t--beam-size=NUM, -b NUM\n"
+    << "\t\tWith --beam, keep NUM rollouts at each level (0 = use the SizeBeam array of the game, default: "<<d.beamSize<<").\n"
+
+    << "\t--algo=NAME, -g NAME\n"
+    << "\t\tSearch engine, nrpa or nmcs (Nested Monte Carlo Search, with strategy 1 = level parallel, 2 = root parallel) (default: "<<d.algo<<").\n"
+
+    << "\t--batch-size=NUM, -z NUM\n"
+    << "\t\tWhen level 1 is not the parallel level, run its playouts by batches of NUM under the same policy, on the idle threads, and learn the best of each batch (default: "<<d.batchSize<<").\n"
+
+    << "\t--metrics-file=FILE, -M FILE\n"
+    << "\t\tWrite live metrics (playouts, policy updates, best score, ...) to FILE in the Prometheus text format, during the whole search (default: None).\n"
+
+    << "\t--metrics-period=SEC, -E SEC\n"
+    << "\t\tRewrite the metrics file every SEC seconds (default: "<<d.metricsPeriod<<").\n"
+
+    << "\t--stats-stream=FILE, -y FILE\n"
+    << "\t\tAppend the iteration (and with -S timer) statistics to FILE as they are recorded, with no limit on the number of runs and iterations. Use stream2dat to get .dat files (default: None).\n"
+
+    << "\t--stats-stream-binary, -Y\n"
+    << "\t\tWrite the statistics stream in a compact binary format (default: "<<yesnostring(d.statsStreamBinary)<<").\n"
+
+    << "\t--trace=FILE, -j FILE\n"
+    << "\t\tRecord a timeline of the threads (tasks, waits, policy updates, improvements) and write it to FILE in the Chrome trace format (default: None).\n"
+
+    << "\t--trace-size=NUM, -J NUM\n"
+    << "\t\tWith --trace, keep the last NUM events of each thread (default: "<<d.traceSize<<").\n"
+
+    << "\t--perf-counters, -C\n"
+    << "\t\tCount cycles, instructions, cache misses and branch misses of the search threads (perf_event_open), by phase when built with PHASE_TIMERS=1 (default: no).\n"
+
+    << "\t--mem-limit=SIZE, -L SIZE\n"
+    << "\t\tFail at startup if the search structures need more than SIZE bytes (suffix K, M or G, 0 = no limit, default: "<<d.memLimit<<").\n"
+
+    << "\t--mem-report, -R\n"
+    << "\t\tPrint the memory estimate at startup, and the memory of each structure, the occupancy of the policies and the peak RSS after each run (default: no).\n"
+
+    << "\t--bench=FILE, -U FILE\n"
+    << "\t\tRun the microbenchmarks of the engine kernels (policy, playout, updatePolicy, LegalMoves copy, thread pool) on this domain instead of the test, and write the results to FILE as JSON, or CSV if FILE ends with .csv (- = stdout, default: None).\n"
+
+    << "\t--bench-time=SEC, -V SEC\n"
+    << "\t\tRun each microbenchmark for at least SEC seconds (default: "<<d.benchTime<<").\n"
+
     << "\t--thread-stats, -q\n"
     << "\t\tEnable thread statistics (default: "<<d.threadStats<<").\n"
 
@@ -96,6 +192,50 @@ inline void Options::usage(const std::string &binName, std::ostream &os) {
 inline Options Options::parse(int &argc, char **&argv, bool exitOnError){
   using namespace std; 
   Options o; 
+  bool parseOnly = o.update(argc, argv, exitOnError); 
+
+  /* shift all remaining arguments in argv. */
+  for(int i = 1; i < argc; i++) 
+    argv[i] = argv[ i + optind - 1]; 
+  argc -= optind - 1;
+  
+  if(parseOnly){
+    o.printAll(); 
+    if(exitOnError) exit(1);
+    else exit(0); 
+  }
+  else{
+    o.print();
+    return o;
+  }
+}
+
+inline Options Options::withArgs(const std::string &args) const{
+  using namespace std; 
+  istringstream is(args); 
+  vector<string> words(1, "portfolio"); 
+  string word; 
+  while(is >> word) words.push_back(word); 
+
+  vector<char *> argv; 
+  for(string &w: words) argv.push_back(&w[0]); 
+  argv.push_back(nullptr); 
+
+  Options o = *this; 
+  int savedOptind = optind; 
+  optind = 0; // restart getopt from scratch
+  o.update(words.size(), argv.data(), true); 
+  if(optind < (int)words.size()){
+    cerr<<"Unexpected argument in \""<<args<<"\": "<<argv[optind]<<endl; 
+    exit(1); 
+  }
+  optind = savedOptind; 
+  return o; 
+}
+
+inline bool Options::update(int argc, char **argv, bool exitOnError){
+  using namespace std; 
+  Options &o = *this; 
   int c;
   bool parseOnly = false; 
      
@@ -114,6 +254,28 @@ inline Options Options::parse(int &argc, char **&argv, bool exitOnError){
 	  {"tag",    required_argument,       0, 'T'},
 	  {"parallel-level", required_argument, 0, 'p'}, 
 	  {"parallel-strat", required_argument, 0, 'P'}, 
+	  {"over-decomp", required_argument, 0, 'd'}, 
+	  {"staleness", required_argument, 0, 'k'}, 
+	  {"merge-period", required_argument, 0, 'm'}, 
+	  {"auto-parallel", no_argument, 0, 'A'}, 
+	  {"concurrent-runs", required_argument, 0, 'K'}, 
+	  {"portfolio", required_argument, 0, 'F'}, 
+	  {"portfolio-policy", no_argument, 0, 'W'}, 
+	  {"beam", no_argument, 0, 'B'}, 
+	  {"beam-size", required_argument, 0, 'b'}, 
+	  {"algo", required_argument, 0, 'g'}, 
+	  {"batch-size", required_argument, 0, 'z'}, 
+	  {"metrics-file", required_argument, 0, 'M'}, 
+	  {"metrics-period", required_argument, 0, 'E'}, 
+	  {"stats-stream", required_argument, 0, 'y'}, 
+	  {"stats-stream-binary", no_argument, 0, 'Y'}, 
+	  {"trace", required_argument, 0, 'j'}, 
+	  {"trace-size", required_argument, 0, 'J'}, 
+	  {"perf-counters", no_argument, 0, 'C'}, 
+	  {"mem-limit", required_argument, 0, 'L'}, 
+	  {"mem-report", no_argument, 0, 'R'}, 
+	  {"bench", required_argument, 0, 'U'}, 
+	  {"bench-time", required_argument, 0, 'V'}, 
 	  {"thread-stats", no_argument, 0, 'q'}, 
 	  {"seed", required_argument, 0, 'a'}, 
 	  {"help", no_argument, 0, 'h'}, 
@@ -122,7 +284,7 @@ inline Options Options::parse(int &argc, char **&argv, bool exitOnError){
 	};
 
       int option_index = 0;
-      c = getopt_long (argc, argv, "r:l:n:x:t:sSf:T:p:qP:a:ho",
+      c = getopt_long (argc, argv, "r:l:n:x:t:sSf:T:p:qP:d:k:m:AK:F:WBb:g:z:M:E:y:Yj:J:CL:RU:V:a:ho",
 		       long_options, &option_index);
      
       /* Detect the end of the options. */
@@ -173,6 +335,72 @@ inline Options Options::parse(int &argc, char **&argv, bool exitOnError){
 	case 'P':
 	  o.parStrat = atoi(optarg); 
 	  break;
+	case 'd':
+	  o.overDecomp = atoi(optarg); 
+	  break;
+	case 'k':
+	  o.staleness = atoi(optarg); 
+	  break;
+	case 'm':
+	  o.mergePeriod = atoi(optarg); 
+	  break;
+	case 'A':
+	  o.autoParallel = true; 
+	  break;
+	case 'K':
+	  o.concurrentRuns = atoi(optarg); 
+	  break;
+	case 'F':
+	  o.portfolio = optarg; 
+	  break;
+	case 'W':
+	  o.portfolioPolicy = true; 
+	  break;
+	case 'B':
+	  o.beam = true; 
+	  break;
+	case 'b':
+	  o.beamSize = atoi(optarg); 
+	  break;
+	case 'g':
+	  o.algo = optarg; 
+	  break;
+	case 'z':
+	  o.batchSize = atoi(optarg); 
+	  break;
+	case 'M':
+	  o.metricsFile = optarg; 
+	  break;
+	case 'E':
+	  o.metricsPeriod = atof(optarg); 
+	  break;
+	case 'y':
+	  o.statsStream = optarg; 
+	  break;
+	case 'Y':
+	  o.statsStreamBinary = true; 
+	  break;
+	case 'j':
+	  o.traceFile = optarg; 
+	  break;
+	case 'J':
+	  o.traceSize = atoi(optarg); 
+	  break;
+	case 'C':
+	  o.perfCounters = true; 
+	  break;
+	case 'L':
+	  o.memLimit = optarg; 
+	  break;
+	case 'R':
+	  o.memReport = true; 
+	  break;
+	case 'U':
+	  o.bench = optarg; 
+	  break;
+	case 'V':
+	  o.benchTime = atof(optarg); 
+	  break;
 	case 'q':
 	  o.threadStats = true; 
 	  break;
@@ -195,20 +423,7 @@ inline Options Options::parse(int &argc, char **&argv, bool exitOnError){
 	}
     }
 
-  /* shift all remaining arguments in argv. */
-  for(int i = 1; i < argc; i++) 
-    argv[i] = argv[ i + optind - 1]; 
-  argc -= optind - 1;
-  
-  if(parseOnly){
-    o.printAll(); 
-    if(exitOnError) exit(1);
-    else exit(0); 
-  }
-  else{
-    o.print();
-    return o;
-  }
+  return parseOnly; 
 }
 
 inline void Options::printAll(std::ostream &os, const std::string &prefix) const{
@@ -224,6 +439,28 @@ inline void Options::printAll(std::ostream &os, const std::string &prefix) const
   os<<prefix<<"tag = \""<<tag<<"\"\n"; 
   os<<prefix<<"parallelLevel = "<<parallelLevel<<"\n"; 
   os<<prefix<<"parallelStrat = "<<parStrat<<"\n";
+  os<<prefix<<"overDecomp = "<<overDecomp<<"\n";
+  os<<prefix<<"staleness = "<<staleness<<"\n";
+  os<<prefix<<"mergePeriod = "<<mergePeriod<<"\n";
+  os<<prefix<<"autoParallel = "<<autoParallel<<"\n"; 
+  os<<prefix<<"concurrentRuns = "<<concurrentRuns<<"\n"; 
+  os<<prefix<<"portfolio = \""<<portfolio<<"\"\n"; 
+  os<<prefix<<"portfolioPolicy = "<<portfolioPolicy<<"\n"; 
+  os<<prefix<<"beam = "<<beam<<"\n"; 
+  os<<prefix<<"beamSize = "<<beamSize<<"\n"; 
+  os<<prefix<<"algo = \""<<algo<<"\"\n"; 
+  os<<prefix<<"batchSize = "<<batchSize<<"\n"; 
+  os<<prefix<<"metricsFile = \""<<metricsFile<<"\"\n"; 
+  os<<prefix<<"metricsPeriod = "<<metricsPeriod<<"\n"; 
+  os<<prefix<<"statsStream = \""<<statsStream<<"\"\n"; 
+  os<<prefix<<"statsStreamBinary = "<<statsStreamBinary<<"\n"; 
+  os<<prefix<<"traceFile = \""<<traceFile<<"\"\n"; 
+  os<<prefix<<"traceSize = "<<traceSize<<"\n"; 
+  os<<prefix<<"perfCounters = "<<perfCounters<<"\n"; 
+  os<<prefix<<"memLimit = \""<<memLimit<<"\"\n"; 
+  os<<prefix<<"memReport = "<<memReport<<"\n"; 
+  os<<prefix<<"bench = \""<<bench<<"\"\n"; 
+  os<<prefix<<"benchTime = "<<benchTime<<"\n"; 
   os<<prefix<<"threadStats = "<<threadStats<<"\n"; 
   os<<prefix<<"seed = "<<seed<<"\n"; 
   os<<prefix<<"== End of options =="<<endl; 
@@ -0,0 +1,81 @@
+// context.hpp
+// Per-thread context given by the engine to the boards.
+
+#ifndef CONTEXT_HPP
+#define CONTEXT_HPP
+
+#include <vector>
+#include <memory>
+#include <stdlib.h>
+
+/*
+ * Each thread that runs playouts has its own context, with a random
+ * generator and a scratch arena, so that domain code does not need
+ * mutable globals.
+ *
+ * Boards that need it can define
+ *   void setContext(Context *context);
+ * the engine calls it on every board it creates. Boards created
+ * elsewhere can use Context::current().
+ */
+class Context{
+
+public:
+
+  /* Context of the calling thread */
+  static inline Context &current(){
+    static thread_local Context context;
+    return context;
+  }
+
+  /* Random number in [0, RAND_MAX]. Threads that have been given a
+     seed have their own sequence, other threads share rand() (so
+     sequential runs are not changed by srand()). */
+  inline int random(){
+    return _seeded ? rand_r(&_seed) : rand();
+  }
+
+  /* Random number in [0, 1) */
+  inline double uniform(){
+    return random() / (RAND_MAX + 1.0);
+  }
+
+  inline void seed(unsigned int seed){
+    _seeded = true;
+    _seed = seed;
+  }
+
+  inline bool seeded() const { return _seeded; }
+
+  /* At least n objects of type T, kept for the life of the thread and
+     reused by the next calls with the same slot. A slot must always be
+     used with the same type, its content is not preserved when it
+     grows. */
+  template <typename T>
+  inline T *scratch(size_t n, int slot = 0){
+    if(slot >= (int)_scratch.size()) _scratch.resize(slot + 1);
+    Scratch &s = _scratch[slot];
+    if(s.size < n * sizeof(T)){
+      s.data = std::shared_ptr<void>(new T[n], std::default_delete<T[]>());
+      s.size = n * sizeof(T);
+    }
+    return static_cast<T *>(s.data.get());
+  }
+
+private:
+
+  inline Context(): _seeded(false), _seed(0){}
+  Context(const Context &) = delete;
+
+  struct Scratch{
+    Scratch(): size(0){}
+    std::shared_ptr<void> data;
+    size_t size; // in bytes
+  };
+
+  bool _seeded;
+  unsigned int _seed;
+  std::vector<Scratch> _scratch;
+};
+
+#endif //CONTEXT_HPP
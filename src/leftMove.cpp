@@ -75,12 +75,55 @@ class Board {
   void print (FILE *fp) {
     fprintf (fp, "nbMovesLeft = %d, length = %d\n", nbMovesLeft, length);
   }
+
+  /* W boards advanced in lockstep, used by the batch playouts of Nrpa
+     (see --batch-size) */
+  template <int W>
+  class BatchBoard {
+  public:
+    int length [W];
+    int nbMovesLeft [W];
+    int maxi;
+
+    BatchBoard (int m = 100) {
+      maxi = m;
+      for (int i = 0; i < W; i++) {
+	length [i] = 0;
+	nbMovesLeft [i] = 0;
+      }
+    }
+
+    int code (int lane, Move m) {
+      return m + length [lane] * MaxMoveNumber;
+    }
+
+    int legalMoves (int /* lane */, Move moves [MaxLegalMoves]) {
+      moves [0] = 0;
+      moves [1] = 1;
+      return 2;
+    }
+
+    void play (const Move moves [W], const bool active [W]) {
+      for (int i = 0; i < W; i++) {
+	nbMovesLeft [i] += active [i] & (moves [i] == 0);
+	length [i] += active [i];
+      }
+    }
+
+    bool terminal (int lane) {
+      return length [lane] == maxi;
+    }
+
+    double score (int lane) {
+      return nbMovesLeft [lane];
+    }
+  };
 };
 
 int main(int argc, char *argv []) {
 
-  static Nrpa<Board, Move, 5, MaxPlayoutLength, MaxLegalMoves> nrpa; 
-  nrpa.run(); 
+  Options options = Options::parse(argc, argv);
+  Nrpa<Board, Move, 5, MaxPlayoutLength, MaxLegalMoves>::test(options); 
 
 
 
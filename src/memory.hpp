@@ -0,0 +1,72 @@
+// memory.hpp
+// Process memory usage, and sizes as read and printed by --mem-limit
+// and --mem-report.
+
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class Memory{
+
+public:
+
+  /* Peak and current resident set size in bytes, from /proc/self/status
+     (VmHWM and VmRSS), 0 if it cannot be read */
+  static inline size_t peakRss(){ return status("VmHWM:"); }
+  static inline size_t currentRss(){ return status("VmRSS:"); }
+
+  /* Parse a size with an optional K, M or G suffix (powers of 1024),
+     returns false if str is not a size */
+  static inline bool parseSize(const std::string &str, size_t &size){
+    char *end;
+    double value = strtod(str.c_str(), &end);
+    if(end == str.c_str() || value < 0) return false;
+    double unit = 1;
+    switch(*end){
+    case 'k': case 'K': unit = 1024.; end++; break;
+    case 'm': case 'M': unit = 1024. * 1024.; end++; break;
+    case 'g': case 'G': unit = 1024. * 1024. * 1024.; end++; break;
+    }
+    if(*end == 'B' || *end == 'b') end++;
+    if(*end != '\0') return false;
+    size = value * unit;
+    return true;
+  }
+
+  /* bytes in B, KB, MB or GB */
+  static inline std::string format(double bytes){
+    static const char *units [] = { "B", "KB", "MB", "GB", "TB" };
+    int u = 0;
+    while(bytes >= 1024 && u < 4){
+      bytes /= 1024;
+      u++;
+    }
+    std::ostringstream os;
+    os<<std::fixed<<std::setprecision(u == 0 ? 0 : 1)<<bytes<<" "<<units[u];
+    return os.str();
+  }
+
+private:
+
+  static inline size_t status(const char *key){
+    FILE *f = fopen("/proc/self/status", "r");
+    if(!f) return 0;
+    char line[256];
+    size_t kb = 0;
+    while(fgets(line, sizeof(line), f))
+      if(strncmp(line, key, strlen(key)) == 0){
+	kb = strtoul(line + strlen(key), nullptr, 10);
+	break;
+      }
+    fclose(f);
+    return kb * 1024;
+  }
+};
+
+#endif //MEMORY_HPP
@@ -0,0 +1,218 @@
+// metrics.hpp
+// Live counters of the running searches, exported in the Prometheus text format.
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <limits>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+
+/*
+ * Each thread counts its playouts, playout steps and policy updates in
+ * its own counters. They are only written by their thread, so a
+ * relaxed load and store is enough, there is no lock and no atomic
+ * read-modify-write on the playout path.
+ *
+ * When started (--metrics-file), a background thread adds up the
+ * counters of all threads and rewrites the metrics file every period.
+ * The file is written under a temporary name then renamed, so a reader
+ * (e.g. the textfile collector of the Prometheus node exporter) never
+ * sees a partial file.
+ */
+class Metrics{
+
+public:
+
+  struct Counters{
+    Counters(): playouts(0), steps(0), updates(0){}
+    std::atomic<unsigned long> playouts;
+    std::atomic<unsigned long> steps;    // moves played by the playouts
+    std::atomic<unsigned long> updates;  // policy updates
+  };
+
+  static inline Metrics &instance(){
+    static Metrics metrics;
+    return metrics;
+  }
+
+  /* Counters of the calling thread, registered on first use and kept
+     after the thread exits so that the totals never decrease */
+  static inline Counters &local(){
+    static thread_local std::shared_ptr<Counters> counters = instance().registerThread();
+    return *counters;
+  }
+
+  /* Only for counters of the calling thread */
+  static inline void add(std::atomic<unsigned long> &counter, unsigned long n = 1){
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  /* Score of a start level sub-search, improvements of the best score
+     of the current runs are counted. Returns true on improvement. */
+  inline bool improve(double score){
+    double best = _bestScore.load(std::memory_order_relaxed);
+    while(score > best)
+      if(_bestScore.compare_exchange_weak(best, score, std::memory_order_relaxed)){
+	_improvements.fetch_add(1, std::memory_order_relaxed);
+	return true;
+      }
+    return false;
+  }
+
+  /* A new run starts, its best score starts from scratch */
+  inline void newRun(){
+    _bestScore.store(std::numeric_limits<double>::lowest(), std::memory_order_relaxed);
+  }
+
+  /* Policy sizes are costly to compute, the writer asks for one per
+     period and the first search that sees the request answers it */
+  inline bool policySizeRequested() const { return _policySizeRequested.load(std::memory_order_relaxed); }
+  inline void setPolicySize(long size){
+    _policySize.store(size, std::memory_order_relaxed);
+    _policySizeRequested.store(false, std::memory_order_relaxed);
+  }
+
+  inline bool running() const { return _thread != nullptr; }
+
+  /* Rewrite filename every period seconds until stop() */
+  inline void start(const std::string &filename, double period){
+    if(running()) stop();
+    _filename = filename;
+    _period = period;
+    _stop = false;
+    _lastTime = std::chrono::steady_clock::now();
+    _lastPlayouts = _lastUpdates = 0;
+    _policySizeRequested = true;
+    _thread = new std::thread([this]{ writerThread(); });
+  }
+
+  /* Write the file one last time and stop the writer */
+  inline void stop(){
+    if(!running()) return;
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      _stop = true;
+    }
+    _cond.notify_all();
+    _thread->join();
+    delete _thread;
+    _thread = nullptr;
+  }
+
+  /* All metrics in the Prometheus text format */
+  inline void write(std::ostream &os){
+    using namespace std::chrono;
+    unsigned long playouts = 0, steps = 0, updates = 0;
+    int nbThreads;
+    {
+      std::lock_guard<std::mutex> lk(_registryMutex);
+      nbThreads = _counters.size();
+      for(auto &c : _counters){
+	playouts += c->playouts.load(std::memory_order_relaxed);
+	steps += c->steps.load(std::memory_order_relaxed);
+	updates += c->updates.load(std::memory_order_relaxed);
+      }
+    }
+
+    steady_clock::time_point now = steady_clock::now();
+    double elapsed = duration<double>(now - _lastTime).count();
+    double playoutRate = elapsed > 0 ? (playouts - _lastPlayouts) / elapsed : 0;
+    double updateRate = elapsed > 0 ? (updates - _lastUpdates) / elapsed : 0;
+    _lastTime = now;
+    _lastPlayouts = playouts;
+    _lastUpdates = updates;
+
+    double best = _bestScore.load(std::memory_order_relaxed);
+
+    metric(os, "nrpa_playouts_total", "counter", "Playouts made by all threads.", playouts);
+    metric(os, "nrpa_playout_steps_total", "counter", "Moves played by the playouts.", steps);
+    metric(os, "nrpa_policy_updates_total", "counter", "Policy updates made by all threads.", updates);
+    metric(os, "nrpa_improvements_total", "counter", "Improvements of the best score of the current runs.",
+	   _improvements.load(std::memory_order_relaxed));
+    metric(os, "nrpa_playouts_per_second", "gauge", "Playouts per second over the last period.", playoutRate);
+    metric(os, "nrpa_policy_updates_per_second", "gauge", "Policy updates per second over the last period.", updateRate);
+    if(best != std::numeric_limits<double>::lowest())
+      metric(os, "nrpa_best_score", "gauge", "Best score of the current runs.", best);
+    metric(os, "nrpa_policy_size", "gauge", "Number of codes in the policy of a start level search.",
+	   _policySize.load(std::memory_order_relaxed));
+    metric(os, "nrpa_threads", "gauge", "Threads that have made playouts.", nbThreads);
+  }
+
+  ~Metrics(){ stop(); }
+
+private:
+
+  Metrics(): _bestScore(std::numeric_limits<double>::lowest()), _improvements(0),
+	     _policySize(0), _policySizeRequested(false), _period(1), _stop(false),
+	     _lastPlayouts(0), _lastUpdates(0), _thread(nullptr){}
+  Metrics(const Metrics &) = delete;
+
+  inline std::shared_ptr<Counters> registerThread(){
+    std::shared_ptr<Counters> counters(new Counters);
+    std::lock_guard<std::mutex> lk(_registryMutex);
+    _counters.push_back(counters);
+    return counters;
+  }
+
+  template <typename T>
+  static inline void metric(std::ostream &os, const char *name, const char *type, const char *help, T value){
+    os<<"# HELP "<<name<<" "<<help<<"\n";
+    os<<"# TYPE "<<name<<" "<<type<<"\n";
+    os<<name<<" "<<value<<"\n";
+  }
+
+  inline void writeFile(){
+    std::string tmp = _filename + ".tmp";
+    {
+      std::ofstream ofs(tmp);
+      if(!ofs){
+	std::cerr<<"Warning : cannot write metrics file "<<tmp<<"."<<std::endl;
+	return;
+      }
+      write(ofs);
+    }
+    rename(tmp.c_str(), _filename.c_str());
+    _policySizeRequested.store(true, std::memory_order_relaxed);
+  }
+
+  inline void writerThread(){
+    std::unique_lock<std::mutex> lk(_mutex);
+    while(!_stop){
+      _cond.wait_for(lk, std::chrono::duration<double>(_period), [this]{ return _stop; });
+      writeFile();
+    }
+  }
+
+  std::atomic<double> _bestScore;
+  std::atomic<unsigned long> _improvements;
+  std::atomic<long> _policySize;
+  std::atomic<bool> _policySizeRequested;
+
+  std::mutex _registryMutex;
+  std::vector<std::shared_ptr<Counters>> _counters;
+
+  std::string _filename;
+  double _period;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  bool _stop;
+
+  /* Rates, only used by the writer */
+  std::chrono::steady_clock::time_point _lastTime;
+  unsigned long _lastPlayouts;
+  unsigned long _lastUpdates;
+
+  std::thread *_thread;
+};
+
+#endif //METRICS_HPP
@@ -0,0 +1,96 @@
+// nmcs.hpp
+// Nested Monte Carlo Search, with the same Board interface as Nrpa.
+
+#ifndef NMCS_HPP
+#define NMCS_HPP
+
+#include <vector>
+#include <atomic>
+#include <limits>
+
+#include "threadpool.hpp"
+#include "context.hpp"
+#include "cli.hpp"
+#include "stats.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+/*
+ * Nested Monte Carlo Search (Cazenave 2009).
+ *
+ * At level n, each legal move of the current position is evaluated by a
+ * search of level n - 1 (a random playout at level 0), then the move of
+ * the best sequence found so far is played, until the position is
+ * terminal.
+ *
+ * Template arguments are the ones of Nrpa, it is selected with
+ * --algo=nmcs. Two parallel modes (--parallel-strat):
+ * 1 = level parallel: at the parallel level, the searches that evaluate
+ *     the moves of a position are run as tasks of the thread pool.
+ * 2 = root parallel: independent searches are run from the root, one
+ *     per thread, the best one is kept.
+ */
+template <typename B, typename M, int L, int PL, int LM>
+class Nmcs {
+  friend class Stats<Nmcs<B,M,L,PL,LM>>;
+
+public:
+
+  Nmcs(int maxThreads = 0, int parLevel = 1, bool threadStats = false);
+
+  /* Set the parallel mode and statistics from the options */
+  void configure(const Options &o);
+
+  /* One nmcs run */
+  double run(int level = L - 1);
+
+  /* Make multiple runs, collect statistics (see Nrpa::test) */
+  static double test(const Options &options);
+
+private:
+
+  /* A sequence of moves, from a position to a terminal position */
+  struct Sequence{
+    Sequence(): score(std::numeric_limits<double>::lowest()){}
+    double score;
+    std::vector<M> moves;
+  };
+
+  /* Search from board, the best sequence found is stored in best. top
+     is true for the searches made from the root of a run. */
+  void search(const B &board, int level, Sequence &best, bool top);
+  void playout(const B &board, Sequence &sequence);
+
+  /* Evaluate each move of board with a search of level level - 1 */
+  void evaluate(const B &board, M *moves, int nbMoves, int level, std::vector<Sequence> &results);
+
+  void improve(double score);
+  double bestScore() const { return _bestScore; }
+
+  /* One run of test(), with statistics */
+  double testRun(const Options &o);
+
+  static void errorif(bool cond, const std::string &msg = "unknown.");
+
+  int _startLevel;
+  int _nbThreads;
+  int _parLevel;
+  int _parStrat;
+  std::atomic<double> _bestScore; // best score of the current run
+
+  static ThreadPool &_threadPool; // globalThreadPool()
+
+  Stats<Nmcs<B,M,L,PL,LM>> _stats;
+
+  /* Give its context to a board that has a setContext() method */
+  template <typename T>
+  static auto giveContext(T &board, Context *context, int) -> decltype(board.setContext(context), void()){
+    board.setContext(context);
+  }
+  template <typename T>
+  static void giveContext(T &, Context *, long){}
+};
+
+#include "nmcs.inl"
+
+#endif //NMCS_HPP
@@ -0,0 +1,273 @@
+// nmcs.inl
+// Nested Monte Carlo Search, with the same Board interface as Nrpa.
+#include <limits>
+#include <algorithm>
+#include <future>
+
+
+template <typename B,typename  M, int L, int PL, int LM>
+Nmcs<B,M,L,PL,LM>::Nmcs(int maxThreads, int parLevel, bool threadStats):
+  _startLevel(0),
+  _parStrat(1),
+  _bestScore(numeric_limits<double>::lowest()){
+
+  if(maxThreads == 1){
+    _nbThreads = 1;
+    _parLevel = 0;
+  }
+  else{
+    if( ! _threadPool.initialized() ){
+      if(maxThreads == 0)
+	_threadPool.init(ThreadPool::availableCpus() - 1, threadStats);
+      else
+	_threadPool.init(maxThreads - 1, threadStats);
+    }
+    if(maxThreads == 0)
+      _nbThreads = _threadPool.nbThreads() + 1; // main thread included
+    else
+      _nbThreads = maxThreads;
+    _parLevel = parLevel;
+  }
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nmcs<B,M,L,PL,LM>::configure(const Options &o){
+  _parStrat = o.parStrat;
+  errorif(_parStrat != 1 && _parStrat != 2, "nmcs parallel strategy should be 1 (level) or 2 (root).");
+
+  if(o.iterStats)  _stats.initIterStats();
+  if(o.timerStats) _stats.initTimerStats();
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nmcs<B,M,L,PL,LM>::run(int level){
+  assert(level < L);
+
+  _startLevel = level;
+  _bestScore = numeric_limits<double>::lowest();
+
+  B board;
+  Sequence best;
+
+  if(_parStrat == 2 && _nbThreads > 1){
+    /* Root parallel: independent searches, this thread makes the last one */
+    int nbSearches = min(_nbThreads, _threadPool.enter() + 1);
+    vector<Sequence> results(nbSearches);
+    vector<future<int>> done;
+    for(int t = 0; t < nbSearches - 1; t++)
+      done.push_back(_threadPool.submit([ this, &board, &results, level, t ]() -> int {
+	    search(board, level, results[t], false);
+	    return 0;
+	  }));
+    search(board, level, results[nbSearches - 1], true);
+    for(int t = 0; t < nbSearches - 1; t++)
+      done[t].wait();
+    _threadPool.leave();
+
+    for(int t = 0; t < nbSearches; t++)
+      if(results[t].score > best.score) best = results[t];
+  }
+  else
+    search(board, level, best, true);
+
+  _stats.resetTimeout();
+
+  cout<<"Bestscore: "<<best.score<<endl;
+  return best.score;
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nmcs<B,M,L,PL,LM>::search(const B &board, int level, Sequence &best, bool top){
+  using namespace std;
+
+  if(level == 0){
+    playout(board, best);
+    return;
+  }
+
+  B current = board;
+  vector<M> played; // moves played by this search
+  vector<Sequence> results;
+  best = Sequence();
+
+  while(! current.terminal()){
+    M moves [LM];
+    int nbMoves = current.legalMoves(moves);
+
+    evaluate(current, moves, nbMoves, level, results);
+
+    for(int i = 0; i < nbMoves; i++){
+      if(results[i].score > best.score){
+	best.score = results[i].score;
+	best.moves = played;
+	best.moves.push_back(moves[i]);
+	best.moves.insert(best.moves.end(), results[i].moves.begin(), results[i].moves.end());
+      }
+    }
+
+    /* Follow the best sequence */
+    M next = best.moves[played.size()];
+    current.play(next);
+    played.push_back(next);
+
+    if(level == _startLevel){
+      improve(best.score);
+      if(top){
+	if (level > L - 3)
+	  fprintf(stdout, "Level : %d, N:%d, score : %f\n", level, (int)played.size() - 1, best.score);
+	_stats.recordIterStats(played.size() - 1, bestScore());
+      }
+    }
+
+    if(_stats.timeout()) break;
+  }
+
+  if(best.score == numeric_limits<double>::lowest()) // board was terminal
+    best.score = current.score();
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nmcs<B,M,L,PL,LM>::evaluate(const B &board, M *moves, int nbMoves, int level, vector<Sequence> &results){
+  results.assign(nbMoves, Sequence());
+
+  auto eval = [ this, &board, moves, level, &results ](int i) -> int {
+    B child = board;
+    child.play(moves[i]);
+    search(child, level - 1, results[i], false);
+    return 0;
+  };
+
+  if(_parStrat == 1 && level == _parLevel && _nbThreads > 1){
+    /* Level parallel: moves are claimed one at a time by the threads */
+    int nbWorkers = min(_nbThreads, _threadPool.enter() + 1);
+    nbWorkers = min(nbWorkers, nbMoves);
+    atomic<int> next(0);
+    auto work = [ &next, &eval, nbMoves ]() -> int {
+      int i;
+      while((i = next++) < nbMoves)
+	eval(i);
+      return 0;
+    };
+    vector<future<int>> done;
+    for(int w = 0; w < nbWorkers - 1; w++)
+      done.push_back(_threadPool.submit(work));
+    work();
+    for(int w = 0; w < nbWorkers - 1; w++)
+      done[w].wait();
+    _threadPool.leave();
+  }
+  else
+    for(int i = 0; i < nbMoves; i++)
+      eval(i);
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nmcs<B,M,L,PL,LM>::playout(const B &board, Sequence &sequence){
+  Context &context = Context::current();
+  B current = board;
+  giveContext(current, &context, 0);
+  sequence.moves.clear();
+
+  while(! current.terminal()){
+    M moves [LM];
+    int nbMoves = current.legalMoves(moves);
+    int j = nbMoves * context.uniform();
+    sequence.moves.push_back(moves[j]);
+    current.play(moves[j]);
+  }
+  sequence.score = current.score();
+
+  Metrics::Counters &counters = Metrics::local();
+  Metrics::add(counters.playouts);
+  Metrics::add(counters.steps, sequence.moves.size());
+}
+
+/* Best score of the run, also updated by the root parallel searches */
+template <typename B,typename  M, int L, int PL, int LM>
+void Nmcs<B,M,L,PL,LM>::improve(double score){
+  double best = _bestScore.load(memory_order_relaxed);
+  while(score > best && !_bestScore.compare_exchange_weak(best, score, memory_order_relaxed));
+  if(Metrics::instance().improve(score)) Tracer::instant("improvement", "search", score);
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nmcs<B,M,L,PL,LM>::testRun(const Options &o){
+  _stats.startRun(this, o.timeout);
+  Metrics::instance().newRun();
+  double score = run(o.numLevel);
+  _stats.finishRun();
+  return score;
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nmcs<B,M,L,PL,LM>::test(const Options &o){
+  int nbRun = o.numRun;
+  int level = o.numLevel;
+
+  if(o.seed >= 0){
+    if(o.seed == 0)
+      srand(clock() * getpid());
+    else
+      srand(o.seed);
+  }
+  _threadPool.seed(o.seed > 0 ? o.seed : (o.seed == 0 ? clock() * getpid() : 1));
+
+  errorif(level >= L, "level should be lower than L template argument.");
+
+  double avgscore = 0;
+  double maxscore = numeric_limits<double>::lowest();
+
+  Stats<Nmcs<B,M,L,PL,LM>> stats; // statistics of all runs
+  if(o.iterStats)  stats.initIterStats();
+  if(o.timerStats) stats.initTimerStats();
+
+  if(!o.metricsFile.empty()) Metrics::instance().start(o.metricsFile, o.metricsPeriod);
+  if(!o.traceFile.empty()){
+    Tracer::nameThread("main");
+    Tracer::instance().start(o.traceSize);
+  }
+  if(o.perfCounters && !PerfCounters::instance().start())
+    cerr<<"Warning : hardware counters unavailable ("<<PerfCounters::instance().error()<<"), --perf-counters ignored."<<endl;
+  if(!o.statsStream.empty()){
+    ostringstream header;
+    o.print(header, "# ");
+    errorif(!StatStream::instance().open(o.statsStream, o.statsStreamBinary, header.str()),
+	    "cannot open statistics stream " + o.statsStream + ".");
+  }
+
+  for(int i = 0; i < nbRun; i++){
+    Nmcs<B,M,L,PL,LM> nmcs(o.numThread, o.parallelLevel, o.threadStats);
+    nmcs.configure(o);
+    double score = nmcs.testRun(o);
+    stats.copyRun(i, nmcs._stats);
+    avgscore += score;
+    maxscore = max(maxscore, score);
+  }
+
+  Metrics::instance().stop();
+  StatStream::instance().close();
+  PerfCounters::instance().stop();
+  if(!o.traceFile.empty()){
+    Tracer::instance().stop();
+    errorif(!Tracer::instance().dump(o.traceFile), "cannot write trace file " + o.traceFile + ".");
+    cout<<"Trace filename: "<<o.traceFile<<endl;
+  }
+
+  stats.writeStats(o.statfilePrefix, o);
+  if(o.perfCounters) PerfCounters::instance().print(cout);
+
+  cout<<"Avgscore: "<< avgscore / nbRun<<endl;
+  cout<<"Bestscore-overall: "<< maxscore <<endl;
+  return avgscore / nbRun;
+}
+
+template <typename B,typename M, int L, int PL, int LM>
+void Nmcs<B,M,L,PL,LM>::errorif(bool cond, const std::string &msg){
+  if(cond){
+    cerr<<"Error : "<<msg<<endl;
+    exit(1);
+  }
+}
+
+template <typename B, typename M, int L, int PL, int LM>
+ThreadPool &Nmcs<B,M,L,PL,LM>::_threadPool = globalThreadPool();
@@ -9,13 +9,25 @@
 #include <cmath>
 #include <limits>
 #include <atomic>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+#include <vector>
+#include <chrono>
 #include <time.h>
+#include <stdlib.h>
 
 #include "rollout.hpp"
 #include "policy.hpp"
 #include "threadpool.hpp"
 #include "cli.hpp"
 #include "stats.hpp"
+#include "context.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "phasetimers.hpp"
+#include "memory.hpp"
+#include "nmcs.hpp"
 
 /* Old constants kepts for compatibility with old game file. Their
  * values are set to old defaults, they have no effect on the nrpa
@@ -33,9 +45,13 @@ extern int startLearning;
 /* 
  * Main class for the Nrpa algorith. 
  *
- * Warning: You may create multiple instance of this class (with
- * different parameters), but only one instance can run at a time.
- * (i.e., no parallel calls to Nrpa::run() or Nrpa::test() is allowed)
+ * You may create multiple instance of this class (with different
+ * parameters) and run them at the same time from different threads,
+ * they only share the thread pool. Playouts draw their random numbers
+ * from the Context of their thread (see context.hpp): runs made from
+ * the same thread share rand(), unless the thread is given its own
+ * seed stream with setSeedStream() (see --concurrent-runs), workers of
+ * the thread pool have their own seed streams.
  * 
  * Here is how to run a Nrpa with all the defaults: 
  * Nrpa<Board, Move, 5, MaxPlayoutLength, MaxLegalMoves>::test(Options::parse(argc, argv));
@@ -47,20 +63,45 @@ extern int startLearning;
  * PL = Playout maximum length (in nb moves) 
  * LM = Maximum number of legal moves for each turn 
  */ 
+template <typename B, typename M, int L, int PL, int LM>
+class Bench; // bench.hpp
+
 template <typename B, typename M, int L, int PL, int LM>
 class Nrpa {
   friend class Stats<Nrpa<B,M,L,PL,LM>>; 
+  friend class Bench<B,M,L,PL,LM>; 
 
 public: 
 
   static constexpr double ALPHA = 1.0; 
   static const int MAX_THREADS = 128; 
+
+  /* --auto-parallel: decisions are taken after each of the first
+     AUTO_NB_ITER iterations of the start level. Sub-searches shorter
+     than AUTO_MIN_TASK seconds are too small for the thread pool,
+     rounds where threads are busy less than AUTO_MIN_UTIL of the time
+     are too unbalanced for the shared policy strategy, and rounds with
+     sub-searches for less than AUTO_MIN_UTIL of the threads (or still
+     unbalanced under strategy 3) call for a lower parallel level. */
+  static const int AUTO_NB_ITER = 3; 
+  static constexpr double AUTO_MIN_TASK = 0.001; 
+  static constexpr double AUTO_MIN_UTIL = 0.75; 
+
+  /* Number of boards of a BatchBoard (see playoutBatch) */ 
+  static const int BATCH_WIDTH = 8; 
  
   Nrpa(int maxThreads = 0, int parLevel = 1, bool threadStats = false);
 
+  /* Set strategy parameters and statistics from the options */ 
+  void configure(const Options &o); 
+
   /* One nrpa run */
   double run(int level = L - 1, int nbIter = 10, int timeout = -1); 
 
+  /* Playouts made by the calling thread use their own random
+     sequence, seeded with seed, instead of rand() */ 
+  static void setSeedStream(unsigned int seed); 
+
   /* Nrpa testing methods, (make multiple runs, collect statstics etc */
   /* Options is described in cli.hpp */ 
   static double test(const Options &options); 
@@ -80,7 +121,7 @@ private:
     future<int> result; // only used for parallel calls. 
 
     void updatePolicy(double alpha = ALPHA); 
-    double playout (const Policy &policy);
+    template <typename P> double playout (const P &policy); // P = Policy or AtomicPolicy
     inline NrpaLevel &operator=(const NrpaLevel &o){ //TODO move elsewhere
       bestScore = o.bestScore;
       levelPolicy = o.levelPolicy;
@@ -93,36 +134,223 @@ private:
 
   double run(NrpaLevel *nl, int level, const Policy &policy);
   double runseq(NrpaLevel *nl, int level, const Policy &policy);     
+  double runseqBatch(NrpaLevel *nl, const Policy &policy); // level 1, --batch-size
   double runparSharedPolicy(NrpaLevel *nl, int level, const Policy &policy); // paper
   double runparThreadLocalPolicy0(NrpaLevel *nl, int level, const Policy &policy); 
   double runparThreadLocalPolicy1(NrpaLevel *nl, int level, const Policy &policy); //paper
+  double runparAsyncPolicy(NrpaLevel *nl, int level, const Policy &policy); 
+  double runparHogwildPolicy(NrpaLevel *nl, int level, const Policy &policy); 
+  double runparAveragedPolicy(NrpaLevel *nl, int level, const Policy &policy); 
 
   /* helper functions for threadLocalPolicies */
   int doTask0(NrpaLevel *nl, NrpaLevel *localnl, int level, int tid, mutex *m); 
-  int doTask1(NrpaLevel *nl, NrpaLevel *localnl, int level, int tid, mutex *m); 
 
+  /* Best rollout shared by the threads of runparThreadLocalPolicy1. The
+     rollout itself is stored in the parent NrpaLevel, it is published
+     under a sequence lock: writers (rare, only on improvement) are
+     serialized by a mutex, readers never lock and retry if a write
+     happened while they were copying. */
+  struct SharedBest{
+    atomic<double> score; // score of the published rollout, checked without any lock
+    atomic<unsigned> seq; // odd while a write is in progress
+    mutex writer; 
+  }; 
+
+  int doTask1(NrpaLevel *nl, NrpaLevel *localnl, int level, int tid, SharedBest *shared); 
+  void publishBest(NrpaLevel *nl, const NrpaLevel *localnl, SharedBest *shared); 
+  void fetchBest(const NrpaLevel *nl, NrpaLevel *localnl, SharedBest *shared); 
+
+  /* State shared between the updater and the workers of runparAsyncPolicy */
+  struct PolicySnapshot{
+    int version; 
+    Policy policy; 
+  }; 
+
+  struct AsyncState{
+    shared_ptr<const PolicySnapshot> snapshot; // latest published policy, use atomic_load/atomic_store
+    mutex m; 
+    condition_variable arrived;  // a worker has pushed a result
+    condition_variable consumed; // the updater is done with a worker result
+    deque<pair<int, int>> results; // (tid, snapshot version)
+    bool pending[MAX_THREADS]; 
+    bool stop; 
+  }; 
+
+  int doTaskAsync(AsyncState *state, int level, int tid); 
+
+  /* Best rollout of a hogwild worker (there is no thread-local policy), or one playout of a batch (--batch-size) */ 
+  struct LocalBest{
+    Rollout<PL> bestRollout; 
+    LegalMoves<PL, LM> legalMoveCodes;
+  }; 
+
+  double doTaskHogwild(LocalBest *local, int level, int tid, AtomicPolicy *policy); 
+  /* State shared by the threads of runparAveragedPolicy */ 
+  struct AveragingState{
+    AveragingState(int nbThreads): barrier(nbThreads), stop(false){}
+    Barrier barrier; 
+    NrpaLevel *locals; // thread-local copies of the parent level
+    bool stop;         // only written by the barrier completion
+  }; 
+
+  int doTaskAveraging(NrpaLevel *nl, int level, int tid, AveragingState *state); 
+  void mergeBuckets(NrpaLevel *nl, int begin, int end, NrpaLevel *locals); 
+
+  static void updatePolicy(AtomicPolicy &policy, const Rollout<PL> &rollout,
+			   const LegalMoves<PL, LM> &legalMoveCodes, double alpha = ALPHA); 
+  static void updatePolicy(Policy &policy, const Rollout<PL> &rollout,
+			   const LegalMoves<PL, LM> &legalMoveCodes, double alpha = ALPHA); 
+
+  /* One playout with policy, stored in rollout */ 
+  template <typename P> 
+  static double playout(const P &policy, Rollout<PL> &rollout, LegalMoves<PL, LM> &legalMoveCodes); 
+
+  /* Batch boards (opt-in): a board class may define a class template
+   *   template <int W> class BatchBoard; 
+   * that stores W boards as arrays (struct of arrays) and advances them
+   * in lockstep, with 
+   *   bool terminal(int lane); 
+   *   int legalMoves(int lane, M moves[LM]); 
+   *   int code(int lane, M move); 
+   *   void play(const M moves[W], const bool active[W]); // one move for each active lane
+   *   double score(int lane); 
+   * playoutBatch() then makes its playouts BATCH_WIDTH at a time,
+   * otherwise one after the other with playout(). */ 
+  template <typename T>
+  static auto hasBatchBoard(int) -> decltype(typename T::template BatchBoard<BATCH_WIDTH>(), std::true_type()); 
+  template <typename T>
+  static std::false_type hasBatchBoard(long); 
+  typedef decltype(hasBatchBoard<B>(0)) BatchBoardTag; 
+
+  /* n playouts with policy, stored in out[0 .. n) */ 
+  static void playoutBatch(const Policy &policy, LocalBest *out, int n) { playoutBatch(policy, out, n, BatchBoardTag()); }
+  static void playoutBatch(const Policy &policy, LocalBest *out, int n, std::true_type); 
+  static void playoutBatch(const Policy &policy, LocalBest *out, int n, std::false_type); 
+
+
+  /* Best score of the current run, read by the timer of Stats */ 
+  double bestScore() const { return _nrpa[_startLevel].bestRollout.score(); }
+
+  void autoParallel(int level, int iter); 
+
+  /* Entry of a beam (--beam): a rollout and the policy used by the
+     next sub-searches started from it */ 
+  struct BeamEntry{
+    BeamEntry(){ rollout.reset(); legalMoveCodes.setNbSteps(0); }
+    Rollout<PL> rollout; 
+    LegalMoves<PL, LM> legalMoveCodes; 
+    unique_ptr<Policy> policy; // not set for the results of level 0, kept by entries that are reused
+  }; 
+  typedef vector<unique_ptr<BeamEntry>> Beam; 
+
+  /* Entries are taken from and given back to a spare list, instead of
+     being allocated for each playout */ 
+  void runBeam(int level, const Policy &policy, Beam &result, Beam &spare); 
+  static unique_ptr<BeamEntry> takeEntry(Beam &spare); 
+  void releaseEntry(Beam &spare, unique_ptr<BeamEntry> entry); 
+  static void setPolicy(BeamEntry &entry, const Policy &policy); 
+  int beamSize(int level) const; 
+  static bool sameRollout(const Rollout<PL> &r1, const Rollout<PL> &r2); 
+
+  /* Best rollout shared by the configurations of a portfolio
+     (--portfolio). Each configuration checks it after every iteration
+     of its start level: it publishes its own best rollout if it is
+     better, or takes the shared one if it has changed and is better. */ 
+  struct Incumbent{
+    Incumbent(bool sharePolicy): score(numeric_limits<double>::lowest()), version(0),
+				 config(-1), sharePolicy(sharePolicy), start(chrono::steady_clock::now()){}
+    atomic<double> score; // score of the shared rollout, checked without any lock
+    atomic<int> version;  // incremented on each improvement
+    mutex m; 
+    int config;           // configuration that produced the shared rollout
+    Rollout<PL> bestRollout; 
+    LegalMoves<PL, LM> legalMoveCodes; 
+    Policy policy;        // policy of the level that produced it (only if sharePolicy)
+    bool sharePolicy; 
+    chrono::steady_clock::time_point start; 
+  }; 
+
+  void shareIncumbent(NrpaLevel *nl, int iter); 
+
+  /* One run of test(), with statistics */ 
+  double testRun(const Options &o); 
+  static void testConcurrent(const Options &o, Stats<Nrpa<B,M,L,PL,LM>> &stats, vector<double> &scores); 
+  static void testPortfolio(const Options &o, Stats<Nrpa<B,M,L,PL,LM>> &stats, vector<double> &scores); 
+
+  /* Per-thread data structures of the parallel strategies, allocated on first use */ 
+  NrpaLevel *subs(int n); 
+  NrpaLevel *locals(); 
+  LocalBest *localBests(); 
+
+  /* Number of threads of a parallel call, from the current size of the pool */ 
+  int enterParallel(); 
+  int parallelThreads(int poolSize); 
+
+  /* Memory of the structures preallocated by test() (--mem-limit), for
+     all its instances, and for one instance with nbThreads threads */ 
+  static size_t memoryEstimate(const Options &o); 
+  static size_t instanceMemory(const Options &o, int nbThreads); 
+
+  /* Bytes of each structure of this instance and occupancy of the level policies (--mem-report) */ 
+  void printMemory(std::ostream &os) const; 
 
   static void errorif(bool cond, const std::string &msg = "unknown."); 
   int _startLevel; 
   int _nbIter; 
 
-  /* Data structures for simple, recursive calls */
-  static NrpaLevel _nrpa[L];
+  /* Data structures for simple, recursive calls (one per level) */
+  unique_ptr<NrpaLevel[]> _nrpa;
 
   /* parallel calls */
-  static int _nbThreads; 
-  static int _parLevel; 
-  static ThreadPool _threadPool; 
+  int _nbThreads;  // threads of the current (or last) parallel call
+  int _maxThreads; // 0 = use the whole pool
+  int _nbShares;   // number of instances sharing the pool (concurrent tests)
+  int _parLevel; 
+  static ThreadPool &_threadPool; // globalThreadPool()
 
   /* Data structures for parallel calls */ 
-  static NrpaLevel _subs[MAX_THREADS]; 
+  unique_ptr<NrpaLevel[]> _subs; 
+  int _nbSubs; 
+  unique_ptr<NrpaLevel[]> _locals;       // thread-local copies of the parent level (strategies 2, 3 and 6)
+  int _nbLocals; 
+  unique_ptr<AtomicPolicy> _sharedPolicy; // strategy 5
+  unique_ptr<LocalBest[]> _localBests;    // strategy 5
+  int _nbLocalBests; 
+
+  Stats<Nrpa<B,M,L,PL,LM>> _stats; 
+
+  int _parStrat;
+  int _staleness; 
+  int _overDecomp; 
+  int _mergePeriod; 
+  bool _autoParallel; 
+  bool _beam; 
+  int _beamSize; // 0 = SizeBeam[level]
+  Beam _beamSpare;          // entries reused by the searches of this thread
+  vector<Beam> _beamSpares; // the same, for each task of the parallel level
+  size_t _beamSpareMax;     // entries kept by each spare list
+  int _batchSize; // level 1 playouts run under the same policy
+  typename Stats<Nrpa<B,M,L,PL,LM>>::RoundStats _autoLast; // round stats at the last decision
+  int _autoMove; // direction of the parallel level changes (+1 raised, -1 lowered), never reversed
+
+  /* Portfolio mode */ 
+  Incumbent *_incumbent; 
+  int _configId; 
+  int _incumbentVersion; // last version of the incumbent seen by this instance
 
-  static Stats<Nrpa<B,M,L,PL,LM>> _stats; 
+  bool _printScore; // print the score of the run at its end (concurrent runs print them in run order)
 
-  static int _parStrat;
+  /* Give its context to a board that has a setContext() method */ 
+  template <typename T>
+  static auto giveContext(T &board, Context *context, int) -> decltype(board.setContext(context), void()){
+    board.setContext(context); 
+  }
+  template <typename T>
+  static void giveContext(T &, Context *, long){}
   
 }; 
 
 #include "nrpa.inl"
+#include "bench.hpp"
 
 #endif 
@@ -9,7 +9,27 @@
 
 
 template <typename B,typename  M, int L, int PL, int LM>
-Nrpa<B,M,L,PL,LM>::Nrpa(int maxThreads, int parLevel, bool threadStats){
+Nrpa<B,M,L,PL,LM>::Nrpa(int maxThreads, int parLevel, bool threadStats):
+  _nrpa(new NrpaLevel[L]),
+  _maxThreads(maxThreads),
+  _nbShares(1),
+  _nbSubs(0),
+  _nbLocals(0),
+  _nbLocalBests(0),
+  _parStrat(1),
+  _staleness(-1),
+  _overDecomp(1),
+  _mergePeriod(1),
+  _autoParallel(false),
+  _beam(false),
+  _beamSize(0),
+  _beamSpareMax(0),
+  _batchSize(1),
+  _autoMove(0),
+  _incumbent(nullptr),
+  _configId(0),
+  _incumbentVersion(0),
+  _printScore(true){
   assert(maxThreads < MAX_THREADS); 
 
   if(maxThreads == 1){
@@ -19,19 +39,39 @@ Nrpa<B,M,L,PL,LM>::Nrpa(int maxThreads, int parLevel, bool threadStats){
   }
   else{
     if( ! _threadPool.initialized() ){
-      if(maxThreads == 0){
-	_threadPool.init(thread::hardware_concurrency() - 1, threadStats); 
-	_nbThreads = _threadPool.nbThreads() + 1; // main thread included
-      }
-      else{
+      if(maxThreads == 0)
+	_threadPool.init(ThreadPool::availableCpus() - 1, threadStats); 
+      else
 	_threadPool.init(maxThreads - 1, threadStats);
-	_nbThreads = maxThreads; 
-      }
-      _parLevel = parLevel; 
     }
+    if(maxThreads == 0)
+      _nbThreads = _threadPool.nbThreads() + 1; // main thread included
+    else
+      _nbThreads = maxThreads; 
+    _parLevel = parLevel; 
   }
 }
 
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::configure(const Options &o){
+  _parStrat = o.parStrat; 
+  _staleness = o.staleness; 
+  _overDecomp = o.overDecomp; 
+  errorif(_overDecomp < 1, "over-decomposition should be at least 1."); 
+  _mergePeriod = o.mergePeriod; 
+  errorif(_mergePeriod < 1, "merge period should be at least 1."); 
+  _autoParallel = o.autoParallel; 
+  _beam = o.beam; 
+  _beamSize = o.beamSize; 
+  errorif(_beamSize < 0, "beam size should be positive."); 
+  errorif(_beam && o.parStrat != 1, "--parallel-strat is not used with --beam (the searches of a beam are independent tasks)."); 
+  _batchSize = o.batchSize; 
+  errorif(_batchSize < 1, "batch size should be at least 1."); 
+
+  if(o.iterStats)  _stats.initIterStats();
+  if(o.timerStats) _stats.initTimerStats(); 
+}
+
 template <typename B,typename  M, int L, int PL, int LM>
 double Nrpa<B,M,L,PL,LM>::run(int level, int nbIter, int timeout){
   assert(level < L); 
@@ -39,59 +79,450 @@ double Nrpa<B,M,L,PL,LM>::run(int level, int nbIter, int timeout){
   _startLevel = level; 
   _nbIter = nbIter; 
 
+  if(_autoParallel && _nbThreads > 1){
+    /* Start with strategy 1, which measures its rounds */ 
+    if(_parStrat != 1)
+      cout<<"auto-parallel: overriding --parallel-strat="<<_parStrat<<"."<<endl; 
+    _parStrat = 1; 
+    _autoLast = _stats.roundStats(); 
+    cout<<"auto-parallel: starting with parallel level "<<_parLevel<<" (adapted from --parallel-level) and strategy "<<_parStrat<<"."<<endl; 
+    if(_parLevel >= level)
+      cout<<"auto-parallel: the parallel level is the start level, nothing will be adapted (use a lower --parallel-level)."<<endl; 
+  }
+
   //  setTimers(timeout, true); 
 
   Policy policy; 
-  double score =  run(&_nrpa[level], level, policy);  
+  double score; 
+  if(_beam){
+    /* Spare lists keep as many entries as the beams of a search use */ 
+    _beamSpareMax = 0; 
+    for(int l = 1; l <= level; l++)
+      _beamSpareMax += beamSize(l) * (beamSize(l) + 1); 
+    Beam beam; 
+    runBeam(level, policy, beam, _beamSpare); 
+    score = beam[0]->rollout.score(); 
+  }
+  else
+    score = run(&_nrpa[level], level, policy);  
 
-  cout<<"Bestscore: "<<score<<endl;
+  if(_printScore) cout<<"Bestscore: "<<score<<endl;
   
   return score; 
 }
 
+template <typename B,typename  M, int L, int PL, int LM>
+double Nrpa<B,M,L,PL,LM>::testRun(const Options &o){
+  _stats.startRun(this, o.timeout); 
+  Metrics::instance().newRun(); 
+  double score = run(o.numLevel, o.numIter, o.timeout);
+  _stats.finishRun(); 
+  if(o.memReport){
+    static mutex reportMutex; // runs of a concurrent test
+    lock_guard<mutex> lk(reportMutex); 
+    printMemory(cout); 
+  }
+  return score; 
+}
+
 template <typename B,typename  M, int L, int PL, int LM>
 double Nrpa<B,M,L,PL,LM>::test(const Options &o){
 
   int nbRun = o.numRun;
-  int nbIter = o.numIter;
-  int timeout = o.timeout;
   int nbThreads = o.numThread;
   int level = o.numLevel;
   int parLevel = o.parallelLevel; 
 
-  _parStrat = o.parStrat; 
+  errorif(!o.metricsFile.empty() && o.metricsPeriod <= 0, "metrics period should be positive."); 
+  errorif(!o.traceFile.empty() && o.traceSize < 1, "trace size should be at least 1."); 
+
+  if(o.algo == "nmcs")
+    return Nmcs<B,M,L,PL,LM>::test(o); 
+  errorif(o.algo != "nrpa", "unknown search engine " + o.algo + " (nrpa or nmcs)."); 
+
   if(o.seed >= 0)
     if(o.seed == 0)
       srand(clock() * getpid());
     else
       srand(o.seed); 
+  _threadPool.seed(o.seed > 0 ? o.seed : (o.seed == 0 ? clock() * getpid() : 1)); 
+
+  if(!o.bench.empty()){
+    Bench<B,M,L,PL,LM>::run(o); 
+    return 0; 
+  }
 
   errorif(level >= L, "level should be lower than L template argument."); 
+  errorif(o.concurrentRuns < 1, "concurrent runs should be at least 1."); 
+
+  size_t memLimit = 0; 
+  errorif(!Memory::parseSize(o.memLimit, memLimit), "invalid memory limit " + o.memLimit + " (e.g. 512M, 4G)."); 
+  if(memLimit > 0 || o.memReport){
+    size_t estimate = memoryEstimate(o); 
+    if(o.memReport)
+      cout<<"Memory estimate: "<<Memory::format(estimate)<<" (NrpaLevel "<<Memory::format(sizeof(NrpaLevel))
+	  <<", PL = "<<PL<<", LM = "<<LM<<", L = "<<L<<")"<<endl; 
+    errorif(memLimit > 0 && estimate > memLimit, "the search structures need about " + Memory::format(estimate)
+	    + ", more than the memory limit " + Memory::format(memLimit)
+	    + ". Use fewer threads, fewer concurrent runs or a lower --over-decomp, or lower PL and LM."); 
+  }
   
   double avgscore = 0;
   double maxscore = numeric_limits<double>::lowest(); 
+  vector<double> scores(nbRun); 
+
+  Stats<Nrpa<B,M,L,PL,LM>> stats; // statistics of all runs
+  if(o.iterStats)  stats.initIterStats();
+  if(o.timerStats) stats.initTimerStats(); 
+
+  if(!o.metricsFile.empty()) Metrics::instance().start(o.metricsFile, o.metricsPeriod); 
+  if(!o.statsStream.empty()){
+    ostringstream header; 
+    o.print(header, "# "); 
+    errorif(!StatStream::instance().open(o.statsStream, o.statsStreamBinary, header.str()), 
+	    "cannot open statistics stream " + o.statsStream + "."); 
+  }
+  if(!o.traceFile.empty()){
+    Tracer::nameThread("main"); 
+    Tracer::instance().start(o.traceSize); 
+  }
+  if(o.perfCounters && !PerfCounters::instance().start())
+    cerr<<"Warning : hardware counters unavailable ("<<PerfCounters::instance().error()<<"), --perf-counters ignored."<<endl; 
+  PHASE_RESET(); 
+
+  if(!o.portfolio.empty())
+    testPortfolio(o, stats, scores); 
+  else if(o.concurrentRuns > 1 && nbRun > 1)
+    testConcurrent(o, stats, scores); 
+  else
+    for(int i = 0; i < nbRun; i++){
+      Nrpa<B,M,L,PL,LM> nrpa(nbThreads, parLevel, o.threadStats); 
+      nrpa.configure(o); 
+      scores[i] = nrpa.testRun(o);
+      stats.copyRun(i, nrpa._stats); 
+    }
 
-  if(o.iterStats)  _stats.initIterStats();
-  if(o.timerStats) _stats.initTimerStats(); 
-
-  for(int i = 0; i < o.numRun; i++){
-    Nrpa<B,M,L,PL,LM> nrpa(nbThreads, parLevel, o.threadStats); 
-    _stats.startRun(&nrpa, o.timeout); 
-
-    double score = nrpa.run(level, nbIter, timeout);
-    avgscore += score;
-    maxscore = max(maxscore,  score); 
-
-    _stats.finishRun(); 
+  for(int i = 0; i < nbRun; i++){
+    avgscore += scores[i];
+    maxscore = max(maxscore,  scores[i]); 
   }
   
-  _stats.writeStats(o.statfilePrefix, o); 
+  Metrics::instance().stop(); 
+  StatStream::instance().close(); 
+  PerfCounters::instance().stop(); 
+  if(!o.traceFile.empty()){
+    Tracer::instance().stop(); 
+    errorif(!Tracer::instance().dump(o.traceFile), "cannot write trace file " + o.traceFile + "."); 
+    cout<<"Trace filename: "<<o.traceFile<<endl; 
+  }
+
+  stats.writeStats(o.statfilePrefix, o); 
+  if(o.threadStats) stats.printRoundStats(cout); 
+  if(o.perfCounters) PerfCounters::instance().print(cout); 
+  PHASE_PRINT(cout); 
 
   cout<<"Avgscore: "<< avgscore / nbRun<<endl; 
   cout<<"Bestscore-overall: "<< maxscore <<endl; 
   return avgscore / nbRun; 
 }
 
+/* Runs of test() made concurrently, each by its own thread and a share
+   of the thread pool. Run i draws from the seed stream seed + i instead
+   of the srand() stream shared by sequential runs, so its score is not
+   the one of the sequential run i. It is reproducible when each run has
+   one thread: pool workers have their own streams, which do not depend
+   on the run. */ 
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::testConcurrent(const Options &o, Stats<Nrpa<B,M,L,PL,LM>> &stats, vector<double> &scores){
+  int nbRun = o.numRun; 
+  int nbConcurrent = min(o.concurrentRuns, nbRun); 
+  int nbThreads = o.numThread == 0 ? ThreadPool::availableCpus() : o.numThread; 
+  int share = max(1, nbThreads / nbConcurrent); 
+
+  /* Each run uses its own thread plus (share - 1) threads of the pool */ 
+  if(share > 1 && ! _threadPool.initialized())
+    _threadPool.init(nbConcurrent * (share - 1), o.threadStats); 
+  errorif(share > 1 && _threadPool.nbThreads() < nbConcurrent * (share - 1), 
+	  "thread pool is too small for concurrent runs."); 
+
+  unsigned int seed = o.seed > 0 ? o.seed : (o.seed == 0 ? clock() * getpid() : 1); 
+  cout<<"Running "<<nbConcurrent<<" concurrent run(s) with "<<share<<" thread(s) each."<<endl; 
+
+  atomic<int> next(0); 
+  mutex statsMutex; 
+  vector<thread> threads; 
+  for(int k = 0; k < nbConcurrent; k++){
+    threads.push_back(thread([&o, &stats, &scores, &next, &statsMutex, nbRun, nbConcurrent, share, seed]{
+	  int i; 
+	  PerfCounters::attachThread(); 
+	  while((i = next++) < nbRun){
+	    setSeedStream(seed + i); 
+	    unique_ptr<Nrpa<B,M,L,PL,LM>> nrpa(new Nrpa<B,M,L,PL,LM>(share, o.parallelLevel, o.threadStats)); 
+	    nrpa->_nbShares = nbConcurrent; 
+	    nrpa->_printScore = false; 
+	    nrpa->configure(o); 
+	    scores[i] = nrpa->testRun(o);
+	    lock_guard<mutex> lk(statsMutex); 
+	    stats.copyRun(i, nrpa->_stats); 
+	  }
+	})); 
+  }
+  for(int k = 0; k < nbConcurrent; k++)
+    threads[k].join(); 
+  for(int i = 0; i < nbRun; i++)
+    cout<<"Bestscore: "<<scores[i]<<endl; 
+}
+
+/* Runs of test() in portfolio mode: for each run, all the configurations
+   are run at the same time, each by its own thread with its own seed
+   stream and a share of the thread pool. The score of a run is the best
+   score of all its configurations, its statistics are the ones of the
+   configuration that found it. */ 
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::testPortfolio(const Options &o, Stats<Nrpa<B,M,L,PL,LM>> &stats, vector<double> &scores){
+  vector<string> specs; 
+  vector<Options> configs; 
+  istringstream is(o.portfolio); 
+  string spec; 
+  while(getline(is, spec, ';')){
+    if(spec.find_first_not_of(" \t") == string::npos) continue; 
+    Options c = o.withArgs(spec); 
+    errorif(c.numLevel >= L, "level should be lower than L template argument."); 
+    specs.push_back(spec); 
+    configs.push_back(c); 
+  }
+  errorif(configs.empty(), "portfolio has no configuration."); 
+
+  int nbConfigs = configs.size(); 
+  int nbThreads = o.numThread == 0 ? ThreadPool::availableCpus() : o.numThread; 
+  int share = max(1, nbThreads / nbConfigs); 
+
+  if(share > 1 && ! _threadPool.initialized())
+    _threadPool.init(nbConfigs * (share - 1), o.threadStats); 
+  errorif(share > 1 && _threadPool.nbThreads() < nbConfigs * (share - 1), 
+	  "thread pool is too small for the portfolio."); 
+
+  unsigned int seed = o.seed > 0 ? o.seed : (o.seed == 0 ? clock() * getpid() : 1); 
+  cout<<"Running a portfolio of "<<nbConfigs<<" configuration(s) with "<<share<<" thread(s) each."<<endl; 
+  for(int k = 0; k < nbConfigs; k++){
+    cout<<"Portfolio config #"<<k<<": "<<specs[k]<<endl; 
+    /* These loops have no shared NrpaLevel to publish from or adopt into */ 
+    if(configs[k].beam)
+      cout<<"portfolio: warning, config #"<<k<<" uses --beam and does not share its best rollout."<<endl; 
+    else if(configs[k].parStrat == 5 && !configs[k].autoParallel && configs[k].parallelLevel == configs[k].numLevel && share > 1)
+      cout<<"portfolio: warning, config #"<<k<<" runs strategy 5 at its start level and does not share its best rollout."<<endl; 
+  }
+
+  for(int r = 0; r < o.numRun; r++){
+    Incumbent incumbent(o.portfolioPolicy); 
+    vector<unique_ptr<Nrpa<B,M,L,PL,LM>>> nrpas(nbConfigs); 
+    vector<double> results(nbConfigs); 
+    vector<thread> threads; 
+    for(int k = 0; k < nbConfigs; k++){
+      threads.push_back(thread([&configs, &nrpas, &results, &incumbent, &o, k, share, seed, r, nbConfigs]{
+	    setSeedStream(seed + r * nbConfigs + k); 
+	    PerfCounters::attachThread(); 
+	    nrpas[k].reset(new Nrpa<B,M,L,PL,LM>(share, configs[k].parallelLevel, o.threadStats)); 
+	    nrpas[k]->_nbShares = nbConfigs; 
+	    nrpas[k]->configure(configs[k]); 
+	    nrpas[k]->_incumbent = &incumbent; 
+	    nrpas[k]->_configId = k; 
+	    results[k] = nrpas[k]->testRun(configs[k]); 
+	  })); 
+    }
+    for(int k = 0; k < nbConfigs; k++)
+      threads[k].join(); 
+
+    /* A configuration that does not share (see the warnings above) did
+       not publish its result */ 
+    int best = max_element(results.begin(), results.end()) - results.begin(); 
+    if(incumbent.config >= 0 && incumbent.score >= results[best])
+      best = incumbent.config; 
+    scores[r] = results[best]; 
+    if(incumbent.score > scores[r]) scores[r] = incumbent.score; 
+
+    cout<<"Portfolio run "<<r<<": best score "<<scores[r]<<" found by config #"<<best<<endl; 
+    stats.copyRun(r, nrpas[best]->_stats); 
+  }
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::shareIncumbent(NrpaLevel *nl, int iter){
+  Incumbent *inc = _incumbent; 
+  double score = nl->bestRollout.score(); 
+
+  if(score > inc->score.load(memory_order_relaxed)){
+    lock_guard<mutex> lk(inc->m); 
+    if(score > inc->score.load(memory_order_relaxed)){
+      inc->bestRollout = nl->bestRollout; 
+      inc->legalMoveCodes = nl->legalMoveCodes; 
+      if(inc->sharePolicy) inc->policy = nl->levelPolicy; 
+      inc->config = _configId; 
+      inc->score.store(score, memory_order_relaxed); 
+      _incumbentVersion = ++inc->version; 
+      double elapsed = chrono::duration<double>(chrono::steady_clock::now() - inc->start).count(); 
+      cout<<"portfolio: config #"<<_configId<<" improved the best score to "<<score
+	  <<" (iteration "<<iter<<", "<<elapsed<<" sec.)"<<endl; 
+    }
+  }
+  else if(inc->version.load(memory_order_relaxed) != _incumbentVersion
+	  && inc->score.load(memory_order_relaxed) > score){
+    lock_guard<mutex> lk(inc->m); 
+    nl->bestRollout = inc->bestRollout; 
+    nl->legalMoveCodes = inc->legalMoveCodes; 
+    if(inc->sharePolicy) nl->levelPolicy = inc->policy; 
+    _incumbentVersion = inc->version; 
+  }
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::setSeedStream(unsigned int seed){
+  Context::current().seed(seed); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+typename Nrpa<B,M,L,PL,LM>::NrpaLevel *Nrpa<B,M,L,PL,LM>::subs(int n){
+  if(_nbSubs < n){
+    _subs.reset(new NrpaLevel[n]); 
+    _nbSubs = n; 
+  }
+  return _subs.get(); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+typename Nrpa<B,M,L,PL,LM>::NrpaLevel *Nrpa<B,M,L,PL,LM>::locals(){
+  if(_nbLocals < _nbThreads){
+    _locals.reset(new NrpaLevel[_nbThreads]); 
+    _nbLocals = _nbThreads; 
+  }
+  return _locals.get(); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+typename Nrpa<B,M,L,PL,LM>::LocalBest *Nrpa<B,M,L,PL,LM>::localBests(){
+  if(_nbLocalBests < _nbThreads){
+    _localBests.reset(new LocalBest[_nbThreads]); 
+    _nbLocalBests = _nbThreads; 
+  }
+  return _localBests.get(); 
+}
+
+/* The levels of a run, the per-thread levels of the parallel
+   strategies, the levels a task allocates below the parallel level and
+   the batches are counted, not the codes the policies learn (16 bytes
+   each, plus the growth of their bucket). */ 
+template <typename B,typename  M, int L, int PL, int LM>
+size_t Nrpa<B,M,L,PL,LM>::instanceMemory(const Options &o, int nbThreads){
+  size_t level = sizeof(NrpaLevel); 
+  size_t bytes = L * level; // _nrpa
+  if(nbThreads > 1){
+    bytes += nbThreads * o.overDecomp * level; // _subs
+    bytes += nbThreads * o.parallelLevel * level; // sub-levels of runseq() in the tasks
+    if(o.parStrat == 2 || o.parStrat == 3 || o.parStrat == 6 || o.autoParallel)
+      bytes += nbThreads * level; // _locals
+    if(o.parStrat == 5)
+      bytes += sizeof(AtomicPolicy) + nbThreads * sizeof(LocalBest); 
+  }
+  if(o.batchSize > 1)
+    bytes += nbThreads * o.batchSize * sizeof(LocalBest); 
+  if(o.beam)
+    for(int l = 1; l <= o.numLevel; l++){
+      size_t width = o.beamSize > 0 ? o.beamSize : SizeBeam[l]; 
+      bytes += 2 * (width * width + width) * (sizeof(BeamEntry) + sizeof(Policy)); // and as many spare entries
+    }
+  return bytes; 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+size_t Nrpa<B,M,L,PL,LM>::memoryEstimate(const Options &o){
+  int nbThreads = o.numThread > 0 ? o.numThread : ThreadPool::availableCpus(); 
+  if(!o.portfolio.empty()){
+    vector<Options> configs; 
+    istringstream is(o.portfolio); 
+    string spec; 
+    while(getline(is, spec, ';'))
+      if(spec.find_first_not_of(" \t") != string::npos) configs.push_back(o.withArgs(spec)); 
+    size_t bytes = 0; 
+    int share = max(1, nbThreads / max(1, (int)configs.size())); 
+    for(size_t k = 0; k < configs.size(); k++)
+      bytes += instanceMemory(configs[k], share); 
+    return bytes; 
+  }
+  int nbInstances = o.concurrentRuns > 1 ? min(o.concurrentRuns, o.numRun) : 1; 
+  return nbInstances * instanceMemory(o, max(1, nbThreads / nbInstances)); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::printMemory(std::ostream &os) const{
+  const int MAX_CHAIN = 8; 
+  size_t level = sizeof(NrpaLevel); 
+  os<<"Memory report:"<<endl; 
+  os<<"  NrpaLevel: "<<Memory::format(level)<<" (policy table "<<Memory::format(sizeof(Policy))
+    <<", rollout "<<Memory::format(sizeof(Rollout<PL>))<<", legal moves "<<Memory::format(sizeof(LegalMoves<PL, LM>))
+    <<", other "<<Memory::format(level - sizeof(Policy) - sizeof(Rollout<PL>) - sizeof(LegalMoves<PL, LM>))<<")"<<endl; 
+  os<<"  levels: "<<L<<" x NrpaLevel = "<<Memory::format(L * level)<<endl; 
+  if(_nbSubs > 0)
+    os<<"  subs: "<<_nbSubs<<" x NrpaLevel = "<<Memory::format(_nbSubs * level)<<endl; 
+  if(_nbLocals > 0)
+    os<<"  thread-local levels: "<<_nbLocals<<" x NrpaLevel = "<<Memory::format(_nbLocals * level)<<endl; 
+  if(_nbLocalBests > 0)
+    os<<"  local bests: "<<_nbLocalBests<<" x "<<Memory::format(sizeof(LocalBest))
+      <<" = "<<Memory::format(_nbLocalBests * sizeof(LocalBest))<<endl; 
+  if(_sharedPolicy)
+    os<<"  shared atomic policy: "<<Memory::format(sizeof(AtomicPolicy))<<" ("<<_sharedPolicy->size()<<" codes)"<<endl; 
+
+  /* Codes learnt by the policies of the levels */ 
+  vector<long> chains(MAX_CHAIN + 1, 0); 
+  size_t heap = 0; 
+  for(int l = 0; l < L; l++){
+    const Policy &policy = _nrpa[l].levelPolicy; 
+    vector<long> hist(MAX_CHAIN + 1, 0); 
+    policy.chainLengths(hist); 
+    long nbBuckets = 0, nbUsed = 0; 
+    int longest = 0; 
+    for(int k = 0; k <= MAX_CHAIN; k++){
+      nbBuckets += hist[k]; 
+      if(k > 0) nbUsed += hist[k]; 
+      if(hist[k] > 0) longest = k; 
+      chains[k] += hist[k]; 
+    }
+    if(nbUsed == 0) continue; 
+    heap += policy.memory() - sizeof(Policy); 
+    os<<"  policy of level "<<l<<": "<<policy.size()<<" codes, "<<nbUsed<<"/"<<nbBuckets<<" buckets used ("
+      <<fixed<<setprecision(1)<<100. * nbUsed / nbBuckets<<"%), longest chain "<<longest
+      <<(longest == MAX_CHAIN ? "+" : "")<<", "<<Memory::format(policy.memory() - sizeof(Policy))<<" of codes"<<endl; 
+  }
+  os<<"  chain lengths (all levels):"; 
+  for(int k = 0; k <= MAX_CHAIN; k++)
+    os<<" "<<k<<(k == MAX_CHAIN ? "+" : "")<<":"<<chains[k]; 
+  os<<endl; 
+  os<<"  codes of the level policies: "<<Memory::format(heap)<<endl; 
+  os<<"  peak RSS: "<<Memory::format(Memory::peakRss())<<endl; 
+  os.unsetf(ios::floatfield); 
+  os<<setprecision(6); 
+}
+
+/* Called at the beginning of each parallel call, and before each
+   round of the strategies that have rounds, so that a resize of the
+   pool is followed: threads of the call are taken from the current size
+   of the pool, shared with the other instances of a concurrent test. */ 
+template <typename B,typename  M, int L, int PL, int LM>
+int Nrpa<B,M,L,PL,LM>::enterParallel(){
+  return parallelThreads(_threadPool.enter()); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+int Nrpa<B,M,L,PL,LM>::parallelThreads(int poolSize){
+  int nbWorkers = poolSize / _nbShares; 
+  int nbThreads = min(MAX_THREADS - 1, nbWorkers + 1); // main thread included
+  if(_maxThreads > 0 && !_threadPool.resized()) nbThreads = min(nbThreads, _maxThreads); 
+  if(nbThreads != _nbThreads)
+    cout<<"Parallel calls now use "<<nbThreads<<" thread(s)."<<endl; 
+  _nbThreads = nbThreads; 
+  if(_nbThreads > 1) subs(_nbThreads * _overDecomp); 
+  return _nbThreads; 
+}
+
 template <typename B,typename  M, int L, int PL, int LM>
 double Nrpa<B,M,L,PL,LM>::test(int nbRun, int level, int nbIter, int timeout, int nbThreads){
   Options o;
@@ -107,13 +538,14 @@ template <typename B,typename  M, int L, int PL, int LM>
 double Nrpa<B,M,L,PL,LM>::run(NrpaLevel *nl, int level, const Policy &policy){
   using namespace std; 
   assert(level < L); 
+  PHASE_LEVEL(level); 
 
   double score; 
 
   if (level == 0) {
     score = nl->playout(policy); 
   }
-  else if(_nbThreads > 1 && level == _parLevel){
+  else if(level == _parLevel && enterParallel() > 1){
 
     /* Parallel call */ 
     switch(_parStrat){
@@ -126,17 +558,34 @@ double Nrpa<B,M,L,PL,LM>::run(NrpaLevel *nl, int level, const Policy &policy){
     case 3: 
       score = runparThreadLocalPolicy1(nl, level, policy); 
       break;
+    case 4: 
+      score = runparAsyncPolicy(nl, level, policy); 
+      break;
+    case 5: 
+      score = runparHogwildPolicy(nl, level, policy); 
+      break;
+    case 6: 
+      score = runparAveragedPolicy(nl, level, policy); 
+      break;
     default:
       errorif(true, "Unknown parallelization strategy"); 
     }
+    _threadPool.leave(); 
 
   }
   else{
 
-    /* Sequential call */ 
+    /* Sequential call (possibly because the pool has no thread left) */ 
+    if(level == _parLevel) _threadPool.leave(); 
     score = runseq(nl, level, policy); 
   }
 
+  if(level + 1 == _startLevel){
+    Metrics &metrics = Metrics::instance(); 
+    if(metrics.improve(score)) Tracer::instant("improvement", "search", score); 
+    if(metrics.policySizeRequested()) metrics.setPolicySize(policy.size()); 
+  }
+
   return score; 
 
 }
@@ -147,12 +596,16 @@ double Nrpa<B,M,L,PL,LM>::runseq(NrpaLevel *nl, int level, const Policy &policy)
   assert(level < L); 
   assert(level != 0); // level 0 should be a call to rollout 
 
+  if(level == 1 && _batchSize > 1) return runseqBatch(nl, policy); 
+
+  Tracer::Scope scope("search", "search", level); 
   nl->bestRollout.reset(); 
   nl->levelPolicy = policy; 
 
   /* sequential call */ 
   NrpaLevel *sub; 
-  if(level > _parLevel)
+  bool ownSub = level <= _parLevel; // _parLevel may change during the loop (--auto-parallel)
+  if(!ownSub)
     sub = &_nrpa[level -1];
   else
     sub = new NrpaLevel;
@@ -175,7 +628,11 @@ double Nrpa<B,M,L,PL,LM>::runseq(NrpaLevel *nl, int level, const Policy &policy)
     if(i != _nbIter - 1)
       nl->updatePolicy(); 
 
-    if(level == _startLevel) _stats.recordIterStats(i, *nl); 
+    if(level == _startLevel && _incumbent) shareIncumbent(nl, i); 
+
+    if(level == _startLevel) _stats.recordIterStats(i, nl->bestRollout.score()); 
+
+    if(level == _startLevel && _autoParallel && i < AUTO_NB_ITER) autoParallel(level, i); 
 
     if(_stats.timeout()) break;
 
@@ -184,45 +641,144 @@ double Nrpa<B,M,L,PL,LM>::runseq(NrpaLevel *nl, int level, const Policy &policy)
   /* Cleanup */ 
   if(level == _startLevel)
     _stats.resetTimeout(); 
-  if( level <= _parLevel) delete sub; 
+  if(ownSub) delete sub; 
 
   return nl->bestRollout.score();
 
 }
 
+/* Level 1 with --batch-size: each round runs a batch of playouts under
+   the same policy, on the idle threads of the pool (or one after the
+   other if there is none), then the best playout of the batch is
+   learnt with alpha scaled by the batch size, as in runparSharedPolicy. */ 
+template <typename B,typename  M, int L, int PL, int LM>
+double Nrpa<B,M,L,PL,LM>::runseqBatch(NrpaLevel *nl, const Policy &policy){
+  using namespace std; 
+  const int level = 1; 
+  Tracer::Scope scope("search", "search", level); 
+
+  nl->bestRollout.reset(); 
+  nl->levelPolicy = policy; 
+
+  /* Each thread keeps its batch, level 1 searches of this thread do not
+     overlap. */ 
+  static thread_local vector<LocalBest> batch; 
+  if((int)batch.size() < _batchSize) batch.resize(_batchSize); 
+  LocalBest *playouts = batch.data(); 
+
+  /* Boards that have a BatchBoard run BATCH_WIDTH playouts per task */ 
+  const int width = BatchBoardTag::value ? BATCH_WIDTH : 1; 
+
+  for(int i = 0; i < _nbIter; ){
+    int batchSize = min(_batchSize, _nbIter - i); 
+    int nbGroups = (batchSize + width - 1) / width; 
+
+    _threadPool.parallelFor(0, nbGroups, [ nl, playouts, batchSize, width ](int g){
+	int first = g * width; 
+	playoutBatch(nl->levelPolicy, playouts + first, min(width, batchSize - first)); 
+      }); 
+
+    int best = -1; 
+    double bestScore = nl->bestRollout.score(); 
+    for(int k = 0; k < batchSize; k++){
+      if(playouts[k].bestRollout.score() >= bestScore){
+	bestScore = playouts[k].bestRollout.score(); 
+	best = k; 
+      }
+    }
+    if(best >= 0){
+      nl->bestRollout = playouts[best].bestRollout; 
+      nl->legalMoveCodes = playouts[best].legalMoveCodes; 
+
+      if (level > L - 3)
+	fprintf(stdout,"Level : %d, N:%d, score : %f\n", level, i + best, nl->bestRollout.score());
+    }
+
+    /* The playouts of a batch do not go through run(), which updates
+       the metrics of the searches below the start level */ 
+    if(level == _startLevel){
+      Metrics &metrics = Metrics::instance(); 
+      if(best >= 0 && metrics.improve(nl->bestRollout.score()))
+	Tracer::instant("improvement", "search", nl->bestRollout.score()); 
+      if(metrics.policySizeRequested()) metrics.setPolicySize(nl->levelPolicy.size()); 
+    }
+
+    i += batchSize; 
+
+    if(i < _nbIter)
+      nl->updatePolicy( ALPHA * batchSize ); 
+
+    if(level == _startLevel && _incumbent) shareIncumbent(nl, i - 1); 
+
+    if(level == _startLevel)
+      for(int k = i - batchSize; k < i; k++)
+	_stats.recordIterStats(k, nl->bestRollout.score()); 
+
+    if(_stats.timeout()) break;
+  }
+
+  if(level == _startLevel)
+    _stats.resetTimeout(); 
+
+  return nl->bestRollout.score(); 
+}
+
 template <typename B,typename  M, int L, int PL, int LM>
 double Nrpa<B,M,L,PL,LM>::runparSharedPolicy(NrpaLevel *nl, int level, const Policy &policy){
   using namespace std; 
+  typedef chrono::steady_clock clock; 
   assert(level < L); 
   assert(level != 0); // level 0 should be a call to rollout
 
   nl->bestRollout.reset(); 
   nl->levelPolicy = policy; 
-    
-  for(int i = 0; i < _nbIter; i+= _nbThreads){
+
+  /* Each round runs roundSize sub-searches under the same policy, threads
+     claim them one at a time from a shared counter so that a slow
+     sub-search does not hold back the others. */
+  clock::time_point finish[MAX_THREADS]; 
+
+  for(int i = 0; i < _nbIter; ){
+    if(i > 0) parallelThreads(_threadPool.poll()); // the pool may have been resized, down to this thread alone
+    int maxRoundSize = _nbThreads * _overDecomp; 
+    int roundSize = min(maxRoundSize, _nbIter - i); 
+    int nbWorkers = min(_nbThreads, roundSize); 
+    atomic<int> next(0); 
+    Tracer::Scope round("round", "sync", level); 
+    clock::time_point start = clock::now(); 
+
+    auto work = [ this, nl, level, roundSize, &next, &finish ](int w) -> int {
+      int k; 
+      while((k = next++) < roundSize)
+	run(&_subs[k], level - 1, nl->levelPolicy); 
+      finish[w] = clock::now(); 
+      return 1; 
+    }; 
+
     /* Run n threads */ 
-    for(int j = 0; j < _nbThreads; j++){
-      if(j != _nbThreads - 1){ // push task to threadpool!
-	_subs[j].result = _threadPool.submit([ this, nl, level, j ]() -> int {
-	    NrpaLevel *sub = &_subs[j];
-	    run(sub, level - 1, nl->levelPolicy); return 1; });
-      }
-      else{ // last iter is handled by this thread
-	NrpaLevel *sub = &_subs[j];
-	run(sub, level - 1, nl->levelPolicy);
-      }
+    for(int w = 0; w < nbWorkers - 1; w++) // push task to threadpool!
+      _subs[w].result = _threadPool.submit([ &work, w ]() -> int { return work(w); }); 
+    work(nbWorkers - 1); // last worker is this thread
+
+    {
+      Tracer::Scope scope("wait", "sync"); 
+      for(int w = 0; w < nbWorkers - 1; w++)
+	_subs[w].result.wait(); 
     }
 
+    clock::time_point end = clock::now(); 
+    double idle = 0; 
+    for(int w = 0; w < nbWorkers; w++)
+      idle += chrono::duration<double>(end - finish[w]).count(); 
+    _stats.recordRound(chrono::duration<double>(end - start).count(), idle, nbWorkers, roundSize); 
+
     /* fetch the best rollout among all parallel runs (if any better than before) */ 
     int best = -1; 
     double bestScore = nl->bestRollout.score();// numeric_limits<double>::lowest(); 
-    for(int j = 0; j < _nbThreads; j++){
-      if(j != _nbThreads - 1) 
-	_subs[j].result.wait(); 
-
-      if(_subs[j].bestRollout.score() >= bestScore){
-	bestScore = _subs[j].bestRollout.score(); 
-	best = j;
+    for(int k = 0; k < roundSize; k++){
+      if(_subs[k].bestRollout.score() >= bestScore){
+	bestScore = _subs[k].bestRollout.score(); 
+	best = k;
       }
     }
     if(best >= 0){
@@ -230,7 +786,10 @@ double Nrpa<B,M,L,PL,LM>::runparSharedPolicy(NrpaLevel *nl, int level, const Pol
       nl->legalMoveCodes = _subs[best].legalMoveCodes;
     }
 
-    nl->updatePolicy( ALPHA * _nbThreads );
+    nl->updatePolicy( ALPHA * roundSize );
+    i += roundSize; 
+
+    if(level == _startLevel && _incumbent) shareIncumbent(nl, i - 1); 
 
     if(_stats.timeout()) break; 
 
@@ -250,6 +809,7 @@ int Nrpa<B,M,L,PL,LM>::doTask0(NrpaLevel *nl, NrpaLevel *localnl, int level, int
   // sub is the child nrpalevel 
   NrpaLevel *sub = &_subs[tid];
   double localBest = localnl->bestRollout.score(); 
+  PHASE_LEVEL(level); 
 
   m->lock(); 
   *localnl = *nl; 
@@ -263,6 +823,9 @@ int Nrpa<B,M,L,PL,LM>::doTask0(NrpaLevel *nl, NrpaLevel *localnl, int level, int
     }
     localnl->updatePolicy(); //TODO should this be ALPHA * numthreads (i think it should be)
 
+    /* Only the thread of the run shares with the portfolio (localnl is its own) */ 
+    if(level == _startLevel && _incumbent && tid == _nbThreads - 1) shareIncumbent(localnl, i); 
+
     if(_stats.timeout()) break;
 
   }
@@ -282,10 +845,10 @@ double Nrpa<B,M,L,PL,LM>::runparThreadLocalPolicy0(NrpaLevel *nl, int level, con
   mutex m; 
   double bestScore; 
   int best; 
-  static NrpaLevel localNrpaLevels[MAX_THREADS];
+  NrpaLevel *localNrpaLevels = locals();
 
   for(int j = 0; j < _nbThreads - 1; j++){ 
-    _subs[j].result = _threadPool.submit([ this, nl, level, j, &m, &best ]() -> int {
+    _subs[j].result = _threadPool.submit([ this, nl, level, j, &m, localNrpaLevels ]() -> int {
 	return doTask0(nl, &localNrpaLevels[j], level, j, &m); 
       }); 
   }
@@ -312,16 +875,50 @@ double Nrpa<B,M,L,PL,LM>::runparThreadLocalPolicy0(NrpaLevel *nl, int level, con
 
 
 template <typename B,typename  M, int L, int PL, int LM>
-int Nrpa<B,M,L,PL,LM>::doTask1(NrpaLevel *nl, NrpaLevel *localnl, int level, int tid, mutex *m){
+void Nrpa<B,M,L,PL,LM>::publishBest(NrpaLevel *nl, const NrpaLevel *localnl, SharedBest *shared){
+  {
+    Tracer::Scope scope("lock-wait", "sync"); 
+    shared->writer.lock(); 
+  }
+  lock_guard<mutex> lk(shared->writer, adopt_lock); 
+  double score = localnl->bestRollout.score(); 
+  if(score <= nl->bestRollout.score()) return; // another thread published a better one meanwhile
+
+  shared->seq.fetch_add(1, memory_order_relaxed); // odd: write in progress
+  atomic_thread_fence(memory_order_release); 
+  nl->bestRollout = localnl->bestRollout; 
+  nl->legalMoveCodes = localnl->legalMoveCodes;
+  shared->score.store(score, memory_order_relaxed); 
+  shared->seq.fetch_add(1, memory_order_release); // even: done
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::fetchBest(const NrpaLevel *nl, NrpaLevel *localnl, SharedBest *shared){
+  unsigned before, after; 
+  do{
+    before = shared->seq.load(memory_order_acquire); 
+    if(before & 1){ this_thread::yield(); after = before + 1; continue; }
+    localnl->bestRollout = nl->bestRollout; 
+    localnl->legalMoveCodes = nl->legalMoveCodes;
+    atomic_thread_fence(memory_order_acquire); 
+    after = shared->seq.load(memory_order_relaxed); 
+  } while(before != after); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+int Nrpa<B,M,L,PL,LM>::doTask1(NrpaLevel *nl, NrpaLevel *localnl, int level, int tid, SharedBest *shared){
   // nl is the parent nrpa level
   // localnl is the threadlocal copy of the parent nrpa level // may be removed ? 
   // sub is the child nrpalevel 
   NrpaLevel *sub = &_subs[tid];
-  double localBest = localnl->bestRollout.score(); 
+  PHASE_LEVEL(level); 
 
-  m->lock(); 
+  {
+    Tracer::Scope scope("lock-wait", "sync"); 
+    shared->writer.lock(); 
+  }
   *localnl = *nl; 
-  m->unlock(); 
+  shared->writer.unlock(); 
 
   for(int i = 0; i < _nbIter; i+= _nbThreads){
     double score = run(sub, level - 1, localnl->levelPolicy);
@@ -330,16 +927,16 @@ int Nrpa<B,M,L,PL,LM>::doTask1(NrpaLevel *nl, NrpaLevel *localnl, int level, int
       localnl->legalMoveCodes = sub->legalMoveCodes;
     }
 
-    m->lock();
-    if(nl->bestRollout.score() <= localnl->bestRollout.score()){ // move outside the loop
-      nl->bestRollout = sub->bestRollout; 
-      nl->legalMoveCodes = sub->legalMoveCodes;
-    }
-    else { // nl is better than local nl, 
-      localnl->bestRollout = nl->bestRollout; 
-      localnl->legalMoveCodes = nl->legalMoveCodes;
-    }
-    m->unlock();  
+    /* Only the thread of the run shares with the portfolio (localnl is its own) */ 
+    if(level == _startLevel && _incumbent && tid == _nbThreads - 1) shareIncumbent(localnl, i); 
+
+    /* Common case: nothing improved, only the score word is read */ 
+    double localScore = localnl->bestRollout.score(); 
+    double sharedScore = shared->score.load(memory_order_acquire); 
+    if(localScore > sharedScore)
+      publishBest(nl, localnl, shared); 
+    else if(sharedScore > localScore) // nl is better than local nl
+      fetchBest(nl, localnl, shared); 
 
     localnl->updatePolicy(); //TODO should this be ALPHA * numthreads (i think it should be)
 
@@ -359,19 +956,27 @@ double Nrpa<B,M,L,PL,LM>::runparThreadLocalPolicy1(NrpaLevel *nl, int level, con
   nl->bestRollout.reset(); 
   nl->levelPolicy = policy; 
 
-  mutex m; 
+  typedef chrono::steady_clock clock; 
+  SharedBest shared; 
+  shared.score = nl->bestRollout.score(); 
+  shared.seq = 0; 
   double bestScore; 
   int best; 
-  static NrpaLevel localNrpaLevels[MAX_THREADS];
+  NrpaLevel *localNrpaLevels = locals();
+  clock::time_point finish[MAX_THREADS]; 
+  clock::time_point start = clock::now(); 
 
   for(int j = 0; j < _nbThreads - 1; j++){ 
-    _subs[j].result = _threadPool.submit([ this, nl, level, j, &m, &best ]() -> int {
-	return doTask1(nl, &localNrpaLevels[j], level, j, &m); 
+    _subs[j].result = _threadPool.submit([ this, nl, level, j, &shared, localNrpaLevels, &finish ]() -> int {
+	int score = doTask1(nl, &localNrpaLevels[j], level, j, &shared); 
+	finish[j] = clock::now(); 
+	return score; 
       }); 
   }
 
   /* Do last task in this thread */ 
-  bestScore = doTask1(nl, &localNrpaLevels[_nbThreads - 1], level, _nbThreads - 1, &m); 
+  bestScore = doTask1(nl, &localNrpaLevels[_nbThreads - 1], level, _nbThreads - 1, &shared); 
+  finish[_nbThreads - 1] = clock::now(); 
   best = _nbThreads - 1; 
 
   for(int j = 0; j < _nbThreads - 1; j++){
@@ -382,6 +987,13 @@ double Nrpa<B,M,L,PL,LM>::runparThreadLocalPolicy1(NrpaLevel *nl, int level, con
     }
   }
 
+  /* The whole call is one round for the round statistics (--auto-parallel) */ 
+  clock::time_point end = clock::now(); 
+  double idle = 0; 
+  for(int j = 0; j < _nbThreads; j++)
+    idle += chrono::duration<double>(end - finish[j]).count(); 
+  _stats.recordRound(chrono::duration<double>(end - start).count(), idle, _nbThreads, _nbIter); 
+
   *nl = localNrpaLevels[best]; // TODO is this necessary ?? this in done in doTask3
 
   return nl->bestRollout.score();
@@ -390,14 +1002,316 @@ double Nrpa<B,M,L,PL,LM>::runparThreadLocalPolicy1(NrpaLevel *nl, int level, con
 
 
 template <typename B,typename  M, int L, int PL, int LM>
-double Nrpa<B,M,L,PL,LM>::NrpaLevel::playout (const Policy &policy) {
+int Nrpa<B,M,L,PL,LM>::doTaskAsync(AsyncState *state, int level, int tid){
+  NrpaLevel *sub = &_subs[tid];
+  int nbRuns = 0; 
+
+  while(true){
+    /* Take the latest published policy, the snapshot is kept alive
+       by this reference even if the updater publishes a new one. */
+    shared_ptr<const PolicySnapshot> snapshot = atomic_load(&state->snapshot);
+    run(sub, level - 1, snapshot->policy);
+    nbRuns++; 
+
+    /* Hand the result over to the updater and wait until it is consumed */ 
+    unique_lock<mutex> lk(state->m);
+    if(state->stop) break; 
+    state->pending[tid] = true; 
+    state->results.push_back(make_pair(tid, snapshot->version)); 
+    state->arrived.notify_one(); 
+    {
+      Tracer::Scope scope("wait", "sync"); 
+      state->consumed.wait(lk, [state, tid]{ return !state->pending[tid] || state->stop; }); 
+    }
+    if(state->stop) break; 
+  }
+
+  return nbRuns; 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nrpa<B,M,L,PL,LM>::runparAsyncPolicy(NrpaLevel *nl, int level, const Policy &policy){
+  using namespace std; 
+  assert(level < L); 
+  assert(level != 0); // level 0 should be a call to rollout
+
+  nl->bestRollout.reset(); 
+  nl->levelPolicy = policy; 
+
+  AsyncState state; 
+  state.stop = false; 
+  fill_n(state.pending, MAX_THREADS, false); 
+  shared_ptr<PolicySnapshot> first = make_shared<PolicySnapshot>(); 
+  first->version = 0; 
+  first->policy = policy; 
+  atomic_store(&state.snapshot, shared_ptr<const PolicySnapshot>(first)); 
+
+  /* All threads of the pool are workers, this thread is the updater */ 
+  int nbWorkers = _nbThreads - 1; 
+  for(int j = 0; j < nbWorkers; j++){ 
+    _subs[j].result = _threadPool.submit([ this, &state, level, j ]() -> int {
+	return doTaskAsync(&state, level, j); 
+      }); 
+  }
+
+  int version = 0; 
+  for(int i = 0; i < _nbIter; ){
+    unique_lock<mutex> lk(state.m);
+    {
+      Tracer::Scope scope("wait", "sync"); 
+      state.arrived.wait(lk, [&state]{ return !state.results.empty(); }); 
+    }
+    int tid = state.results.front().first;
+    int resultVersion = state.results.front().second;
+    state.results.pop_front(); 
+    lk.unlock(); 
+
+    /* Any rollout may become the best one, no matter how old its policy is */ 
+    NrpaLevel *sub = &_subs[tid]; 
+    if(sub->bestRollout.score() >= nl->bestRollout.score()){
+      nl->bestRollout = sub->bestRollout; 
+      nl->legalMoveCodes = sub->legalMoveCodes;
+    }
+
+    if(level == _startLevel && _incumbent) shareIncumbent(nl, i); 
+
+    /* ... but results that are too stale do not count as an iteration */ 
+    if(_staleness < 0 || version - resultVersion <= _staleness){
+      if(i != _nbIter - 1){
+	nl->updatePolicy(); 
+	shared_ptr<PolicySnapshot> next = make_shared<PolicySnapshot>(); 
+	next->version = ++version; 
+	next->policy = nl->levelPolicy; 
+	atomic_store(&state.snapshot, shared_ptr<const PolicySnapshot>(next)); 
+      }
+      if(level == _startLevel) _stats.recordIterStats(i, nl->bestRollout.score()); 
+      i++; 
+    }
+
+    lk.lock(); 
+    state.pending[tid] = false; 
+    state.consumed.notify_all(); 
+    lk.unlock(); 
+
+    if(_stats.timeout()) break;
+  }
+
+  /* Release the workers, results still in flight are dropped */ 
+  {
+    lock_guard<mutex> lk(state.m); 
+    state.stop = true; 
+  }
+  state.consumed.notify_all(); 
+  {
+    Tracer::Scope scope("wait", "sync"); 
+    for(int j = 0; j < nbWorkers; j++)
+      _subs[j].result.wait(); 
+  }
+
+  if(level == _startLevel)
+    _stats.resetTimeout(); 
+
+  return nl->bestRollout.score();
+}
+
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nrpa<B,M,L,PL,LM>::doTaskHogwild(LocalBest *local, int level, int tid, AtomicPolicy *policy){
+  NrpaLevel *sub = &_subs[tid];
+  local->bestRollout.reset(); 
+  PHASE_LEVEL(level); 
+
+  for(int i = tid; i < _nbIter; i += _nbThreads){
+    double score; 
+    if(level == 1)
+      score = sub->playout(*policy);
+    else{
+      /* A nested search adapts its own policy, start it from the shared one */ 
+      policy->store(sub->levelPolicy);
+      score = run(sub, level - 1, sub->levelPolicy);
+    }
+
+    if(score >= local->bestRollout.score()){
+      local->bestRollout = sub->bestRollout; 
+      local->legalMoveCodes = sub->legalMoveCodes;
+    }
+
+    updatePolicy(*policy, local->bestRollout, local->legalMoveCodes); 
+
+    if(_stats.timeout()) break;
+  }
+
+  return local->bestRollout.score();
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nrpa<B,M,L,PL,LM>::runparHogwildPolicy(NrpaLevel *nl, int level, const Policy &policy){
+  using namespace std; 
+  assert(level < L); 
+  assert(level != 0); // level 0 should be a call to rollout
+
+  nl->bestRollout.reset(); 
+
+  /* nl->levelPolicy is not used, all threads update the same table in place */ 
+  if(!_sharedPolicy)
+    _sharedPolicy.reset(new AtomicPolicy); 
+  AtomicPolicy *sharedPolicy = _sharedPolicy.get(); 
+  LocalBest *localBests = this->localBests(); 
+  sharedPolicy->load(policy); 
+
+  for(int j = 0; j < _nbThreads - 1; j++){ 
+    _subs[j].result = _threadPool.submit([ this, level, j, sharedPolicy, localBests ]() -> int {
+	doTaskHogwild(&localBests[j], level, j, sharedPolicy); return 1; 
+      }); 
+  }
+
+  /* Do last task in this thread */ 
+  doTaskHogwild(&localBests[_nbThreads - 1], level, _nbThreads - 1, sharedPolicy); 
+
+  int best = _nbThreads - 1; 
+  for(int j = 0; j < _nbThreads - 1; j++){
+    _subs[j].result.wait(); 
+    if(localBests[j].bestRollout.score() > localBests[best].bestRollout.score())
+      best = j;
+  }
+
+  nl->bestRollout = localBests[best].bestRollout; 
+  nl->legalMoveCodes = localBests[best].legalMoveCodes; 
+
+  if(level == _startLevel)
+    _stats.resetTimeout(); 
+
+  return nl->bestRollout.score();
+}
+
+
+/* Average of the thread-local policies over buckets [begin, end), into
+   nl->levelPolicy. A code missing from a policy has weight 0, so the
+   average of the deltas is just the average of the weights. */ 
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::mergeBuckets(NrpaLevel *nl, int begin, int end, NrpaLevel *locals){
+  Policy &merged = nl->levelPolicy; 
+  for(int b = begin; b < end; b++){
+    merged.table[b].clear(); 
+    for(int j = 0; j < _nbThreads; j++){
+      const vector<ProbabilityCode> &bucket = locals[j].levelPolicy.table[b]; 
+      for(int i = 0; i < bucket.size(); i++)
+	merged.updateProb(bucket[i].code, bucket[i].proba / _nbThreads); // stays in bucket b
+    }
+  }
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+int Nrpa<B,M,L,PL,LM>::doTaskAveraging(NrpaLevel *nl, int level, int tid, AveragingState *state){
+  NrpaLevel *sub = &_subs[tid];
+  NrpaLevel *localnl = &state->locals[tid]; 
+  PHASE_LEVEL(level); 
+
+  localnl->levelPolicy = nl->levelPolicy; 
+  localnl->bestRollout.reset(); 
+
+  /* Every thread does the same number of iterations, so they all reach
+     the same merge points */ 
+  int nbLocalIter = (_nbIter + _nbThreads - 1) / _nbThreads; 
+  int nbBuckets = SizeTablePolicy + 1; 
+  int chunk = (nbBuckets + _nbThreads - 1) / _nbThreads; 
+
+  for(int i = 0; i < nbLocalIter; ){
+    for(int k = 0; k < _mergePeriod && i < nbLocalIter; k++, i++){
+      double score = run(sub, level - 1, localnl->levelPolicy);
+      if(score >= localnl->bestRollout.score()){
+	localnl->bestRollout = sub->bestRollout; 
+	localnl->legalMoveCodes = sub->legalMoveCodes;
+      }
+      localnl->updatePolicy(); 
+    }
+
+    /* Merge: the best rollout is gathered by the last thread to arrive ... */ 
+    state->barrier.wait([this, nl, state]{
+	int best = 0; 
+	for(int j = 1; j < _nbThreads; j++)
+	  if(state->locals[j].bestRollout.score() > state->locals[best].bestRollout.score())
+	    best = j;
+	if(state->locals[best].bestRollout.score() >= nl->bestRollout.score()){
+	  nl->bestRollout = state->locals[best].bestRollout; 
+	  nl->legalMoveCodes = state->locals[best].legalMoveCodes; 
+	}
+	state->stop = _stats.timeout(); 
+      }); 
+
+    /* ... policies are averaged in parallel, each thread reduces its own buckets ... */ 
+    mergeBuckets(nl, min(nbBuckets, tid * chunk), min(nbBuckets, (tid + 1) * chunk), state->locals); 
+    state->barrier.wait([this, nl, level, i]{
+	if(level == _startLevel && _incumbent) shareIncumbent(nl, i * _nbThreads - 1); 
+      }); 
+
+    /* ... and every thread continues from the merged policy and the best rollout */ 
+    if(state->stop) break; 
+    localnl->levelPolicy = nl->levelPolicy; 
+    if(nl->bestRollout.score() > localnl->bestRollout.score()){
+      localnl->bestRollout = nl->bestRollout; 
+      localnl->legalMoveCodes = nl->legalMoveCodes; 
+    }
+  }
+
+  return localnl->bestRollout.score();
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+double Nrpa<B,M,L,PL,LM>::runparAveragedPolicy(NrpaLevel *nl, int level, const Policy &policy){
+  using namespace std; 
+  assert(level < L); 
+  assert(level != 0); // level 0 should be a call to rollout
+
+  nl->bestRollout.reset(); 
+  nl->levelPolicy = policy; // also holds the merged policy 
+
+  AveragingState state(_nbThreads); 
+  state.locals = locals(); 
+
+  for(int j = 0; j < _nbThreads - 1; j++){ 
+    _subs[j].result = _threadPool.submit([ this, nl, level, j, &state ]() -> int {
+	return doTaskAveraging(nl, level, j, &state); 
+      }); 
+  }
+
+  /* Do last task in this thread */ 
+  doTaskAveraging(nl, level, _nbThreads - 1, &state); 
+
+  {
+    Tracer::Scope scope("wait", "sync"); 
+    for(int j = 0; j < _nbThreads - 1; j++)
+      _subs[j].result.wait(); 
+  }
+
+  if(level == _startLevel)
+    _stats.resetTimeout(); 
+
+  return nl->bestRollout.score();
+}
+
+
+template <typename B,typename  M, int L, int PL, int LM>
+template <typename P>
+double Nrpa<B,M,L,PL,LM>::NrpaLevel::playout (const P &policy) {
+  return Nrpa<B,M,L,PL,LM>::playout(policy, bestRollout, legalMoveCodes); 
+}
+
+template <typename B,typename  M, int L, int PL, int LM>
+template <typename P>
+double Nrpa<B,M,L,PL,LM>::playout (const P &policy, Rollout<PL> &bestRollout, LegalMoves<PL, LM> &legalMoveCodes) {
   using namespace std; 
   
+  Context &context = Context::current(); 
   B board; 
+  giveContext(board, &context, 0); 
 
   bestRollout.reset(); 
   legalMoveCodes.setNbSteps(0); 
 
+  PHASE_LEVEL(0); 
+  PHASE_START(t); 
+
   while(! board.terminal ()) {
 
     /* board is at a non terminal step, make a new move ... */
@@ -406,6 +1320,7 @@ double Nrpa<B,M,L,PL,LM>::NrpaLevel::playout (const Policy &policy) {
     /* Get all legal moves for this step */ 
     M moves [LM];
     int nbMoves = board.legalMoves (moves);
+    PHASE_LAP(t, LEGAL_MOVES); 
 
     double moveProbs [LM];
 
@@ -413,7 +1328,11 @@ double Nrpa<B,M,L,PL,LM>::NrpaLevel::playout (const Policy &policy) {
     legalMoveCodes.setNbMoves(step, nbMoves); 
     for (int i = 0; i < nbMoves; i++) {
       int c = board.code (moves [i]);
-      moveProbs [i] = exp (policy.prob(c));
+      PHASE_LAP(t, CODE); 
+      double p = policy.prob(c); 
+      PHASE_LAP(t, PROB); 
+      moveProbs [i] = exp (p);
+      PHASE_LAP(t, EXP); 
       legalMoveCodes.setMove(step, i, c); 
     }
 
@@ -424,7 +1343,7 @@ double Nrpa<B,M,L,PL,LM>::NrpaLevel::playout (const Policy &policy) {
 
 
     /* Pick a move randomly according to the policy distribution */
-    double r = (rand () / (RAND_MAX + 1.0)) * sum;
+    double r = context.uniform() * sum;
     int j = 0;
     double s = moveProbs[0];
     while (s < r) { 
@@ -435,23 +1354,157 @@ double Nrpa<B,M,L,PL,LM>::NrpaLevel::playout (const Policy &policy) {
     /* Store move, movecode, and actually play the move */
     assert(step == bestRollout.length()); 
     bestRollout.addMove(legalMoveCodes.move(step, j)); 
+    PHASE_LAP(t, SAMPLE); 
     board.play(moves[j]); 
+    PHASE_LAP(t, PLAY); 
   }
 
   /* Board is terminal */ 
 
+  Metrics::Counters &counters = Metrics::local(); 
+  Metrics::add(counters.playouts); 
+  Metrics::add(counters.steps, bestRollout.length()); 
+
+  PHASE_SKIP(t); 
   double score = board.score(); 
+  PHASE_LAP(t, SCORE); 
   bestRollout.setScore(score);
   return score; 
   
 }
 
 
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::playoutBatch(const Policy &policy, LocalBest *out, int n, std::false_type){
+  for(int k = 0; k < n; k++)
+    playout(policy, out[k].bestRollout, out[k].legalMoveCodes); 
+}
+
+/* Same sampling as playout(), on the lanes of a BatchBoard. The policy
+   is a hash table, its lookups stay scalar, but lanes that reach the
+   same move code at the same step share the lookup and the exp(). */ 
+template <typename B,typename  M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::playoutBatch(const Policy &policy, LocalBest *out, int n, std::true_type){
+  using namespace std; 
+  typedef typename B::template BatchBoard<BATCH_WIDTH> Batch; 
+  const int W = BATCH_WIDTH; 
+
+  Context &context = Context::current(); 
+  PHASE_LEVEL(0); 
+
+  for(int first = 0; first < n; first += W){
+    int width = min(W, n - first); 
+    LocalBest *lanes = out + first; 
+
+    Batch batch; 
+    giveContext(batch, &context, 0); 
+    PHASE_START(t); 
+
+    bool active [W]; 
+    M chosen [W]; 
+    int nbActive = 0; 
+    for(int w = 0; w < W; w++){
+      chosen[w] = M(); 
+      active[w] = w < width && ! batch.terminal(w); 
+      nbActive += active[w]; 
+      if(w < width){
+	lanes[w].bestRollout.reset(); 
+	lanes[w].legalMoveCodes.setNbSteps(0); 
+	if(! active[w]){
+	  PHASE_SKIP(t); 
+	  lanes[w].bestRollout.setScore(batch.score(w)); 
+	  PHASE_LAP(t, SCORE); 
+	}
+      }
+    }
+
+    while(nbActive > 0){
+
+      int cachedCodes [LM]; 
+      double cachedProbs [LM]; 
+      int nbCached = 0; 
+
+      for(int w = 0; w < width; w++){
+	if(! active[w]) continue; 
+	Rollout<PL> &rollout = lanes[w].bestRollout; 
+	LegalMoves<PL, LM> &legalMoveCodes = lanes[w].legalMoveCodes; 
+	int step = rollout.length(); 
+
+	M moves [LM]; 
+	int nbMoves = batch.legalMoves(w, moves); 
+	PHASE_LAP(t, LEGAL_MOVES); 
+
+	double moveProbs [LM]; 
+	legalMoveCodes.setNbSteps(step + 1); 
+	legalMoveCodes.setNbMoves(step, nbMoves); 
+	for (int i = 0; i < nbMoves; i++) {
+	  int c = batch.code(w, moves[i]); 
+	  PHASE_LAP(t, CODE); 
+	  if(i >= nbCached || cachedCodes[i] != c){
+	    cachedCodes[i] = c; 
+	    double p = policy.prob(c); 
+	    PHASE_LAP(t, PROB); 
+	    cachedProbs[i] = exp (p); 
+	    PHASE_LAP(t, EXP); 
+	  }
+	  moveProbs[i] = cachedProbs[i]; 
+	  legalMoveCodes.setMove(step, i, c); 
+	}
+	nbCached = max(nbCached, nbMoves); 
+
+	double sum = moveProbs[0]; 
+	for (int i = 1; i < nbMoves; i++)
+	  sum += moveProbs[i]; 
+
+	/* Pick a move randomly according to the policy distribution */
+	double r = context.uniform() * sum; 
+	int j = 0; 
+	double s = moveProbs[0]; 
+	while (s < r) { 
+	  j++; 
+	  s += moveProbs[j]; 
+	}
+
+	rollout.addMove(legalMoveCodes.move(step, j)); 
+	chosen[w] = moves[j]; 
+	PHASE_LAP(t, SAMPLE); 
+      }
+
+      batch.play(chosen, active); 
+      PHASE_LAP(t, PLAY); 
+
+      nbActive = 0; 
+      for(int w = 0; w < width; w++){
+	if(active[w] && batch.terminal(w)){
+	  active[w] = false; 
+	  PHASE_SKIP(t); 
+	  lanes[w].bestRollout.setScore(batch.score(w)); 
+	  PHASE_LAP(t, SCORE); 
+	}
+	nbActive += active[w]; 
+      }
+    }
+
+    Metrics::Counters &counters = Metrics::local(); 
+    Metrics::add(counters.playouts, width); 
+    for(int w = 0; w < width; w++)
+      Metrics::add(counters.steps, lanes[w].bestRollout.length()); 
+  }
+}
+
 template <typename B,typename M, int L, int PL, int LM>
 void Nrpa<B,M,L,PL,LM>::NrpaLevel::updatePolicy( double alpha ){
+  Nrpa<B,M,L,PL,LM>::updatePolicy(levelPolicy, bestRollout, legalMoveCodes, alpha); 
+}
+
+template <typename B,typename M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::updatePolicy(Policy &levelPolicy, const Rollout<PL> &bestRollout,
+				     const LegalMoves<PL, LM> &legalMoveCodes, double alpha){
 
   //  assert(rollout.length() <= _nrpa[level].legalMoveCodes.size()); 
   using namespace std; 
+  Tracer::Scope scope("policy-update", "policy"); 
+  PHASE_START(t); 
 
   Policy newPol;
   int length = bestRollout.length(); 
@@ -484,39 +1537,277 @@ void Nrpa<B,M,L,PL,LM>::NrpaLevel::updatePolicy( double alpha ){
     for (int j = 0; j < legalMoveCodes.nbMoves(step); j++)
       levelPolicy.setProb (legalMoveCodes.move(step, j), newPol.prob(legalMoveCodes.move(step,j) ));
 
+  PHASE_LAP(t, UPDATE); 
+  Metrics::add(Metrics::local().updates); 
+
   //  *levelPolicy = newPol; 
 
 }
 
+/* Same update as NrpaLevel::updatePolicy, but the policy is shared and
+   updated in place: deltas are computed from the current weights, then
+   added atomically. */ 
 template <typename B,typename M, int L, int PL, int LM>
-void Nrpa<B,M,L,PL,LM>::errorif(bool cond, const std::string &msg){
-  if(cond){
-    cerr<<"Error : "<<msg<<endl;
-    exit(1);
+void Nrpa<B,M,L,PL,LM>::updatePolicy(AtomicPolicy &policy, const Rollout<PL> &rollout,
+				     const LegalMoves<PL, LM> &legalMoveCodes, double alpha){
+  using namespace std; 
+  Tracer::Scope scope("policy-update", "policy"); 
+  PHASE_START(t); 
+
+  vector<pair<int, double>> deltas; 
+  int length = rollout.length(); 
+
+  for(int step = 0; step < length; step++){
+    deltas.push_back(make_pair(rollout.move(step), alpha)); 
+
+    double z = 0.; 
+    for(int i = 0; i < legalMoveCodes.nbMoves(step); i++)
+      z += exp (policy.prob( legalMoveCodes.move(step,i) ));
+
+    for(int i = 0; i < legalMoveCodes.nbMoves(step); i++){
+      int move = legalMoveCodes.move(step, i); 
+      deltas.push_back(make_pair(move, - alpha * exp (policy.prob(move)) / z)); 
+    }
   }
+
+  for(size_t i = 0; i < deltas.size(); i++)
+    policy.updateProb(deltas[i].first, deltas[i].second); 
+
+  PHASE_LAP(t, UPDATE); 
+  Metrics::add(Metrics::local().updates); 
 }
 
+/* Beam NRPA (--beam): each level keeps its best beamSize(level)
+   rollouts, each one with its own policy, instead of a single best
+   rollout. At each iteration, every entry of the beam starts a search of
+   the level below with its policy. The best results, each one with the
+   policy of the entry it comes from, form the next beam, then every
+   policy is adapted towards its rollout. At the parallel level, the
+   searches started by the entries of the beam are independent tasks,
+   each one with its own spare list. */ 
+template <typename B,typename M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::runBeam(int level, const Policy &policy, Beam &result, Beam &spare){
+  using namespace std; 
+  PHASE_LEVEL(level); 
+
+  if(level == 0){
+    result.push_back(takeEntry(spare)); 
+    playout(policy, result.back()->rollout, result.back()->legalMoveCodes); 
+    return; 
+  }
 
+  int width = beamSize(level); 
+  Beam beam, next; 
+  beam.push_back(takeEntry(spare)); 
+  beam[0]->rollout.reset(); 
+  setPolicy(*beam[0], policy); 
+
+  /* Candidates are the current entries (sub false) and the results of
+     their searches, parent is the index of the entry they come from */ 
+  struct Candidate{ unique_ptr<BeamEntry> *entry; int parent; bool sub; }; 
+  vector<Candidate> candidates, selected; 
+  vector<Beam> subs; 
+  vector<Policy *> source; 
+  vector<char> given; 
+
+  for(int i = 0; i < _nbIter; i++){
+    int size = beam.size(); 
+    subs.resize(size); 
+    bool parallel = level == _parLevel && enterParallel() > 1; 
+
+    if(parallel){
+      if((int)_beamSpares.size() < size) _beamSpares.resize(size); 
+      vector<future<int>> results; 
+      for(int b = 0; b < size - 1; b++)
+	results.push_back(_threadPool.submit([ this, level, b, &beam, &subs ]() -> int {
+	      runBeam(level - 1, *beam[b]->policy, subs[b], _beamSpares[b]); 
+	      return 0; 
+	    })); 
+      runBeam(level - 1, *beam[size - 1]->policy, subs[size - 1], _beamSpares[size - 1]); 
+      Tracer::Scope scope("wait", "sync"); 
+      for(int b = 0; b < size - 1; b++)
+	results[b].wait(); 
+      _threadPool.leave(); 
+    }
+    else{
+      if(level == _parLevel) _threadPool.leave(); 
+      for(int b = 0; b < size; b++)
+	runBeam(level - 1, *beam[b]->policy, subs[b], spare); 
+    }
+
+    candidates.clear(); 
+    for(int b = 0; b < size; b++)
+      if(beam[b]->rollout.length() > 0)
+	candidates.push_back(Candidate{ &beam[b], b, false }); 
+    for(int b = 0; b < size; b++)
+      for(size_t k = 0; k < subs[b].size(); k++)
+	candidates.push_back(Candidate{ &subs[b][k], b, true }); 
+    stable_sort(candidates.begin(), candidates.end(), [](const Candidate &c1, const Candidate &c2){
+	return (*c1.entry)->rollout.score() > (*c2.entry)->rollout.score(); 
+      }); 
+
+    selected.clear(); 
+    for(size_t c = 0; c < candidates.size() && (int)selected.size() < width; c++){
+      bool duplicate = false; 
+      for(size_t k = 0; k < selected.size() && !duplicate; k++)
+	duplicate = sameRollout((*candidates[c].entry)->rollout, (*selected[k].entry)->rollout); 
+      if(!duplicate) selected.push_back(candidates[c]); 
+    }
+
+    /* Policies of the selected results: an entry that leaves the beam
+       gives its policy to the first one of its results, the other ones
+       get a copy (assigned to the policy they already have, if any) */ 
+    source.assign(size, nullptr); 
+    given.assign(size, false); 
+    for(int b = 0; b < size; b++)
+      source[b] = beam[b]->policy.get(); 
+    for(size_t k = 0; k < selected.size(); k++)
+      if(!selected[k].sub) given[selected[k].parent] = true; // stays in the beam with its policy
+    for(size_t k = 0; k < selected.size(); k++){
+      if(!selected[k].sub) continue; 
+      int b = selected[k].parent; 
+      BeamEntry &entry = **selected[k].entry; 
+      if(given[b])
+	setPolicy(entry, *source[b]); 
+      else{
+	swap(entry.policy, beam[b]->policy); 
+	source[b] = entry.policy.get(); 
+	given[b] = true; 
+      }
+    }
+
+    /* The next beam, the other entries go back to the spare list of the
+       search they come from */ 
+    double previous = beam[0]->rollout.score(); 
+    next.clear(); 
+    for(size_t k = 0; k < selected.size(); k++)
+      next.push_back(move(*selected[k].entry)); 
+    for(int b = 0; b < size; b++){
+      Beam &from = parallel ? _beamSpares[b] : spare; 
+      if(beam[b]) releaseEntry(from, move(beam[b])); 
+      for(size_t k = 0; k < subs[b].size(); k++)
+	if(subs[b][k]) releaseEntry(from, move(subs[b][k])); 
+      subs[b].clear(); 
+    }
+    beam.swap(next); 
+
+    if(beam[0]->rollout.score() > previous && level > L - 3){
+      for (int t = 0; t < level - 1; t++)
+	fprintf (stdout, "\t");
+      fprintf(stdout,"Level : %d, N:%d, score : %f\n", level, i, beam[0]->rollout.score());
+    }
+
+    if(i != _nbIter - 1)
+      for(size_t k = 0; k < beam.size(); k++)
+	updatePolicy(*beam[k]->policy, beam[k]->rollout, beam[k]->legalMoveCodes); 
+
+    if(level == _startLevel){
+      _nrpa[level].bestRollout = beam[0]->rollout; 
+      _nrpa[level].legalMoveCodes = beam[0]->legalMoveCodes; 
+      _stats.recordIterStats(i, beam[0]->rollout.score()); 
+      if(Metrics::instance().improve(beam[0]->rollout.score()))
+	Tracer::instant("improvement", "search", beam[0]->rollout.score()); 
+    }
+
+    if(_stats.timeout()) break;
+  }
+
+  if(level == _startLevel)
+    _stats.resetTimeout(); 
+
+  result = move(beam); 
+}
 
-/* Instanciation of static NRPA structures */ 
 template <typename B,typename M, int L, int PL, int LM>
-typename Nrpa<B,M,L,PL,LM>::NrpaLevel Nrpa<B,M,L,PL,LM>::_nrpa[L]; 
+unique_ptr<typename Nrpa<B,M,L,PL,LM>::BeamEntry> Nrpa<B,M,L,PL,LM>::takeEntry(Beam &spare){
+  if(spare.empty()) return unique_ptr<BeamEntry>(new BeamEntry); 
+  unique_ptr<BeamEntry> entry = move(spare.back()); 
+  spare.pop_back(); 
+  return entry; 
+}
 
-template <typename B, typename M, int L, int PL, int LM>
-int Nrpa<B,M,L,PL,LM>::_nbThreads; 
+template <typename B,typename M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::releaseEntry(Beam &spare, unique_ptr<BeamEntry> entry){
+  if(spare.size() < _beamSpareMax) spare.push_back(move(entry)); 
+}
 
-template <typename B, typename M, int L, int PL, int LM>
-int Nrpa<B,M,L,PL,LM>::_parLevel; 
+template <typename B,typename M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::setPolicy(BeamEntry &entry, const Policy &policy){
+  if(entry.policy) *entry.policy = policy; 
+  else entry.policy.reset(new Policy(policy)); 
+}
 
-template <typename B, typename M, int L, int PL, int LM>
-int Nrpa<B,M,L,PL,LM>::_parStrat; 
+template <typename B,typename M, int L, int PL, int LM>
+int Nrpa<B,M,L,PL,LM>::beamSize(int level) const{
+  if(_beamSize > 0) return _beamSize; 
+  return level < MaxLevel ? max(1, SizeBeam[level]) : 1; 
+}
 
-template <typename B, typename M, int L, int PL, int LM>
-ThreadPool Nrpa<B,M,L,PL,LM>::_threadPool; 
+template <typename B,typename M, int L, int PL, int LM>
+bool Nrpa<B,M,L,PL,LM>::sameRollout(const Rollout<PL> &r1, const Rollout<PL> &r2){
+  if(r1.score() != r2.score() || r1.length() != r2.length()) return false; 
+  for(int i = 0; i < r1.length(); i++)
+    if(r1.move(i) != r2.move(i)) return false; 
+  return true; 
+}
 
-template <typename B, typename M, int L, int PL, int LM>
-typename Nrpa<B,M,L,PL,LM>::NrpaLevel Nrpa<B,M,L,PL,LM>::_subs[MAX_THREADS]; 
+/* Called between two iterations of the start level, when no parallel
+   call is running, so _parLevel and _parStrat can be changed safely. */ 
+template <typename B,typename M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::autoParallel(int level, int iter){
+  if(_nbThreads <= 1 || (_parStrat != 1 && _parStrat != 3)) return; // nothing to measure
+
+  typename Stats<Nrpa<B,M,L,PL,LM>>::RoundStats now = _stats.roundStats(); 
+  long nbRounds = now.nbRounds - _autoLast.nbRounds; 
+  long nbTasks = now.nbTasks - _autoLast.nbTasks; 
+  double workerTime = now.workerTime - _autoLast.workerTime; 
+  double idleTime = now.idleTime - _autoLast.idleTime; 
+  _autoLast = now; 
+  if(nbRounds == 0 || nbTasks == 0 || workerTime <= 0) return; 
+
+  double taskTime = (workerTime - idleTime) / nbTasks; 
+  double tasksPerRound = (double)nbTasks / nbRounds; 
+  double utilization = 1 - idleTime / workerTime; 
+  /* a sub-search of the level below is about _nbIter times shorter,
+     the level is not lowered back after it was raised (and conversely) */ 
+  bool canRaise = _autoMove >= 0 && _parLevel < level - 1; 
+  bool canLower = _autoMove <= 0 && _parLevel > 1 && taskTime / _nbIter >= AUTO_MIN_TASK; 
+
+  cout<<"auto-parallel: iteration "<<iter<<", strategy "<<_parStrat<<", "<<nbTasks<<" sub-searches of "<<taskTime * 1000
+      <<"ms on average, "<<tasksPerRound<<" per round, utilization "<<utilization * 100<<"%: "; 
+  if(_parStrat == 1 && taskTime < AUTO_MIN_TASK && canRaise){
+    cout<<"parallel level "<<_parLevel<<" -> "<<_parLevel + 1<<" (sub-searches too short)."<<endl; 
+    _parLevel++; 
+    _autoMove = 1; 
+  }
+  else if(_parStrat == 1 && tasksPerRound < AUTO_MIN_UTIL * _nbThreads && canLower){
+    cout<<"parallel level "<<_parLevel<<" -> "<<_parLevel - 1<<" (too few sub-searches per round for "<<_nbThreads<<" threads)."<<endl; 
+    _parLevel--; 
+    _autoMove = -1; 
+  }
+  else if(_parStrat == 1 && utilization < AUTO_MIN_UTIL){
+    cout<<"strategy "<<_parStrat<<" -> 3 (threads wait too long at the end of rounds)."<<endl; 
+    _parStrat = 3; 
+  }
+  else if(_parStrat == 3 && utilization < AUTO_MIN_UTIL && canLower){
+    cout<<"parallel level "<<_parLevel<<" -> "<<_parLevel - 1<<" (threads still wait too long, shorter sub-searches)."<<endl; 
+    _parLevel--; 
+    _autoMove = -1; 
+  }
+  else
+    cout<<"keeping parallel level "<<_parLevel<<" and strategy "<<_parStrat<<"."<<endl; 
+}
+
+template <typename B,typename M, int L, int PL, int LM>
+void Nrpa<B,M,L,PL,LM>::errorif(bool cond, const std::string &msg){
+  if(cond){
+    cerr<<"Error : "<<msg<<endl;
+    exit(1);
+  }
+}
 
-template <typename B, typename M, int L, int PL, int LM>
-Stats<Nrpa<B,M,L,PL,LM>> Nrpa<B,M,L,PL,LM>::_stats; 
 
+
+/* Instanciation of static NRPA structures */ 
+template <typename B, typename M, int L, int PL, int LM>
+ThreadPool &Nrpa<B,M,L,PL,LM>::_threadPool = globalThreadPool(); 
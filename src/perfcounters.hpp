@@ -0,0 +1,265 @@
+// perfcounters.hpp
+// Hardware performance counters of the search threads (--perf-counters),
+// read with perf_event_open.
+
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/*
+ * Each thread that takes part in the search opens its own group of
+ * counters (cycles, instructions, cache misses, branch misses), counting
+ * in user space only, so that it works with perf_event_paranoid <= 2.
+ * Threads attach themselves with attachThread() (pool workers before
+ * each task, run threads at their start), which costs a relaxed load
+ * when the counters are off.
+ *
+ * Containers and virtual machines often have no PMU or forbid
+ * perf_event_open: start() then returns false with the reason in
+ * error(), and the search runs without counters. Counters that cannot
+ * be opened alone (e.g. cache misses in some VMs) are reported as n/a.
+ *
+ * With the phase timers (phasetimers.hpp), the counts are also split by
+ * phase. Each lap then reads the group with a system call, which slows
+ * the search down but is not counted (kernel time is excluded).
+ */
+class PerfCounters{
+
+public:
+
+  enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NB_COUNTERS };
+
+  /* Counters of one thread */
+  struct Group{
+    Group(){
+      for(int k = 0; k < NB_COUNTERS; k++){
+	fds[k] = -1;
+	index[k] = -1;
+      }
+      nbOpen = 0;
+    }
+    ~Group(){
+#ifdef __linux__
+      for(int k = 0; k < NB_COUNTERS; k++)
+	if(fds[k] >= 0) close(fds[k]);
+#endif
+    }
+    int fds [NB_COUNTERS];
+    int index [NB_COUNTERS]; // position in the group read, -1 if not opened
+    int nbOpen;
+  };
+
+  static inline PerfCounters &instance(){
+    static PerfCounters counters;
+    return counters;
+  }
+
+  static inline bool enabled(){
+    return instance()._enabled.load(std::memory_order_relaxed);
+  }
+
+  static inline const char *name(int counter){
+    static const char *names [NB_COUNTERS] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+    return names[counter];
+  }
+
+  /* Start counting in the calling thread and in the threads that attach
+     from now on. Returns false if the counters are unavailable. */
+  inline bool start(){
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      for(auto &g : _groups){
+	control(*g, RESET);
+	control(*g, ENABLE);
+      }
+    }
+    _enabled.store(true, std::memory_order_relaxed);
+    if(! attachThread()){
+      _enabled.store(false, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  inline void stop(){
+    _enabled.store(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lk(_mutex);
+    for(auto &g : _groups) control(*g, DISABLE);
+  }
+
+  inline const std::string &error() const { return _error; }
+
+  /* Open the counters of the calling thread if needed, returns false if
+     they cannot be opened */
+  static inline bool attachThread(){
+    if(! enabled()) return false;
+    std::shared_ptr<Group> &group = local();
+    if(group) return group->nbOpen > 0;
+    group = instance().open();
+    return group->nbOpen > 0;
+  }
+
+  /* Current values of the counters of the calling thread, 0 for the
+     counters that are not opened. Returns false if none is. */
+  static inline bool read(unsigned long long values [NB_COUNTERS]){
+    for(int k = 0; k < NB_COUNTERS; k++) values[k] = 0;
+    std::shared_ptr<Group> &group = local();
+    return group && readGroup(*group, values);
+  }
+
+  /* Is counter opened by every thread */
+  inline bool available(int counter){
+    std::lock_guard<std::mutex> lk(_mutex);
+    if(_groups.empty()) return false;
+    for(auto &g : _groups)
+      if(g->nbOpen > 0 && g->index[counter] < 0) return false;
+    return true;
+  }
+
+  /* Totals of all threads */
+  inline void print(std::ostream &os){
+    unsigned long long totals [NB_COUNTERS] = { 0 };
+    bool open [NB_COUNTERS];
+    int nbThreads = 0;
+    for(int k = 0; k < NB_COUNTERS; k++) open[k] = available(k);
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      for(auto &g : _groups){
+	unsigned long long values [NB_COUNTERS];
+	if(! readGroup(*g, values)) continue;
+	nbThreads++;
+	for(int k = 0; k < NB_COUNTERS; k++) totals[k] += values[k];
+      }
+    }
+    if(nbThreads == 0){
+      os<<"Hardware counters: unavailable ("<<_error<<")."<<std::endl;
+      return;
+    }
+    os<<"Hardware counters ("<<nbThreads<<" thread(s), user space):"<<std::endl;
+    char line[256];
+    for(int k = 0; k < NB_COUNTERS; k++){
+      if(open[k])
+	snprintf(line, sizeof(line), "  %-14s %16llu", name(k), totals[k]);
+      else
+	snprintf(line, sizeof(line), "  %-14s %16s", name(k), "n/a");
+      os<<line;
+      if(k == INSTRUCTIONS && open[CYCLES] && open[INSTRUCTIONS] && totals[CYCLES] > 0)
+	os<<"   IPC "<<(double)totals[INSTRUCTIONS] / totals[CYCLES];
+      if((k == CACHE_MISSES || k == BRANCH_MISSES) && open[k] && open[INSTRUCTIONS] && totals[INSTRUCTIONS] > 0)
+	os<<"   per 1000 instructions "<<1000. * totals[k] / totals[INSTRUCTIONS];
+      os<<std::endl;
+    }
+  }
+
+private:
+
+  enum Control { RESET, ENABLE, DISABLE };
+
+  PerfCounters(): _enabled(false){}
+  PerfCounters(const PerfCounters &) = delete;
+
+  static inline std::shared_ptr<Group> &local(){
+    static thread_local std::shared_ptr<Group> group;
+    return group;
+  }
+
+#ifdef __linux__
+  static inline int openCounter(unsigned long long config, int leader){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+  }
+
+  inline std::shared_ptr<Group> open(){
+    static const unsigned long long configs [NB_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+    std::shared_ptr<Group> group(new Group);
+    int leader = -1;
+    for(int k = 0; k < NB_COUNTERS; k++){
+      int fd = openCounter(configs[k], leader);
+      if(fd < 0){
+	if(leader < 0) setError(std::string("perf_event_open: ") + strerror(errno));
+	continue;
+      }
+      if(leader < 0) leader = fd;
+      group->fds[k] = fd;
+      group->index[k] = group->nbOpen++;
+    }
+    std::lock_guard<std::mutex> lk(_mutex);
+    _groups.push_back(group);
+    return group;
+  }
+
+  static inline void control(Group &group, Control control){
+    static const unsigned long requests [] = { PERF_EVENT_IOC_RESET, PERF_EVENT_IOC_ENABLE, PERF_EVENT_IOC_DISABLE };
+    unsigned long request = requests[control];
+    for(int k = 0; k < NB_COUNTERS; k++)
+      if(group.fds[k] >= 0){ // the first opened counter leads the group
+	ioctl(group.fds[k], request, PERF_IOC_FLAG_GROUP);
+	return;
+      }
+  }
+
+  static inline bool readGroup(Group &group, unsigned long long values [NB_COUNTERS]){
+    for(int k = 0; k < NB_COUNTERS; k++) values[k] = 0;
+    if(group.nbOpen == 0) return false;
+    unsigned long long buf [1 + NB_COUNTERS];
+    int leader = -1;
+    for(int k = 0; k < NB_COUNTERS && leader < 0; k++) leader = group.fds[k];
+    if(::read(leader, buf, sizeof(buf)) < (ssize_t)((1 + group.nbOpen) * sizeof(buf[0]))) return false;
+    for(int k = 0; k < NB_COUNTERS; k++)
+      if(group.index[k] >= 0) values[k] = buf[1 + group.index[k]];
+    return true;
+  }
+#else
+  inline std::shared_ptr<Group> open(){
+    setError("hardware counters are only supported on Linux");
+    std::shared_ptr<Group> group(new Group);
+    std::lock_guard<std::mutex> lk(_mutex);
+    _groups.push_back(group);
+    return group;
+  }
+
+  static inline void control(Group &, Control){}
+
+  static inline bool readGroup(Group &, unsigned long long values [NB_COUNTERS]){
+    for(int k = 0; k < NB_COUNTERS; k++) values[k] = 0;
+    return false;
+  }
+#endif
+
+  inline void setError(const std::string &error){
+    std::lock_guard<std::mutex> lk(_mutex);
+    if(_error.empty()) _error = error;
+  }
+
+  std::atomic<bool> _enabled;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<Group>> _groups;
+  std::string _error;
+};
+
+#endif //PERFCOUNTERS_HPP
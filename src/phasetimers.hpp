@@ -0,0 +1,230 @@
+// phasetimers.hpp
+// Cycle counts of the phases of playouts and policy updates, compiled
+// in with -DNRPA_PHASE_TIMERS (make PHASE_TIMERS=1).
+
+#ifndef PHASETIMERS_HPP
+#define PHASETIMERS_HPP
+
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <iostream>
+#include <stdio.h>
+#include "perfcounters.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * The hot paths are instrumented with the macros below, which expand to
+ * nothing unless NRPA_PHASE_TIMERS is defined:
+ *
+ *   PHASE_LEVEL(level);    // events of this scope count at level
+ *   PHASE_START(t);        // t = time stamp counter
+ *   ... PHASE_LAP(t, CODE); // cycles since t go to CODE, t = now
+ *   PHASE_SKIP(t);         // t = now, the cycles since t are not counted
+ *
+ * Each thread adds to its own table, without lock. The tables are only
+ * added up by print(), when no thread runs a search (end of test()).
+ * Playouts count at level 0, policy updates at the level of the search
+ * that adapts its policy.
+ *
+ * Cycles come from rdtsc on x86, from steady_clock (ns) elsewhere. A
+ * lap costs a counter read (about 20 cycles), which is not negligible
+ * for the shortest phases (code, prob, exp), so compare builds with and
+ * without timers before trusting small differences.
+ *
+ * With --perf-counters, each lap also adds the hardware counters of the
+ * thread (perfcounters.hpp) to the phase.
+ */
+class PhaseTimers{
+
+public:
+
+  enum Phase { LEGAL_MOVES, CODE, PROB, EXP, SAMPLE, PLAY, SCORE, UPDATE, NB_PHASES };
+
+  static const int MAX_LEVELS = 16;
+
+  struct Table{
+    Table(): level(0){
+      for(int l = 0; l < MAX_LEVELS; l++)
+	for(int p = 0; p < NB_PHASES; p++){
+	  cycles[l][p] = calls[l][p] = 0;
+	  for(int k = 0; k < PerfCounters::NB_COUNTERS; k++) events[l][p][k] = 0;
+	}
+      for(int k = 0; k < PerfCounters::NB_COUNTERS; k++) last[k] = 0;
+    }
+    int level; // current level of the thread
+    unsigned long long cycles [MAX_LEVELS][NB_PHASES];
+    unsigned long long calls [MAX_LEVELS][NB_PHASES];
+    unsigned long long events [MAX_LEVELS][NB_PHASES][PerfCounters::NB_COUNTERS]; // hardware counters
+    unsigned long long last [PerfCounters::NB_COUNTERS]; // at the last lap
+  };
+
+  static inline PhaseTimers &instance(){
+    static PhaseTimers timers;
+    return timers;
+  }
+
+  static inline Table &local(){
+    static thread_local std::shared_ptr<Table> table = instance().registerThread();
+    return *table;
+  }
+
+  static inline unsigned long long now(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  /* First time stamp of a series of laps */
+  static inline unsigned long long start(){
+    if(PerfCounters::enabled()) PerfCounters::read(local().last);
+    return now();
+  }
+
+  static inline unsigned long long lap(unsigned long long start, Phase phase){
+    unsigned long long t = now();
+    Table &table = local();
+    table.cycles[table.level][phase] += t - start;
+    table.calls[table.level][phase]++;
+    if(PerfCounters::enabled()){
+      unsigned long long values [PerfCounters::NB_COUNTERS];
+      PerfCounters::read(values);
+      for(int k = 0; k < PerfCounters::NB_COUNTERS; k++){
+	table.events[table.level][phase][k] += values[k] - table.last[k];
+	table.last[k] = values[k];
+      }
+      t = now(); // the read is not counted
+    }
+    return t;
+  }
+
+  /* Set the level of the calling thread for a scope */
+  class Level{
+  public:
+    inline Level(int level): _table(local()), _previous(_table.level){
+      _table.level = level < MAX_LEVELS ? level : MAX_LEVELS - 1;
+    }
+    inline ~Level(){ _table.level = _previous; }
+  private:
+    Table &_table;
+    int _previous;
+  };
+
+  inline void reset(){
+    std::lock_guard<std::mutex> lk(_mutex);
+    for(auto &t : _tables){
+      int level = t->level;
+      *t = Table();
+      t->level = level;
+    }
+  }
+
+  /* Breakdown of all threads, by level then phase */
+  inline void print(std::ostream &os){
+    static const char *names [NB_PHASES] = { "legalMoves", "code", "prob", "exp", "sample", "play", "score", "update" };
+    Table sum;
+    {
+      std::lock_guard<std::mutex> lk(_mutex);
+      for(auto &t : _tables)
+	for(int l = 0; l < MAX_LEVELS; l++)
+	  for(int p = 0; p < NB_PHASES; p++){
+	    sum.cycles[l][p] += t->cycles[l][p];
+	    sum.calls[l][p] += t->calls[l][p];
+	    for(int k = 0; k < PerfCounters::NB_COUNTERS; k++) sum.events[l][p][k] += t->events[l][p][k];
+	  }
+    }
+
+    char line[256];
+#if defined(__x86_64__) || defined(__i386__)
+    os<<"Phase timers (TSC cycles, all threads):"<<std::endl;
+#else
+    os<<"Phase timers (ns, all threads):"<<std::endl;
+#endif
+    snprintf(line, sizeof(line), "%-6s %-11s %16s %7s %14s %12s", "level", "phase", "cycles", "share", "calls", "cycles/call");
+    os<<line<<std::endl;
+    for(int l = 0; l < MAX_LEVELS; l++){
+      unsigned long long total = 0;
+      for(int p = 0; p < NB_PHASES; p++) total += sum.cycles[l][p];
+      if(total == 0) continue;
+      for(int p = 0; p < NB_PHASES; p++){
+	if(sum.calls[l][p] == 0) continue;
+	snprintf(line, sizeof(line), "%-6d %-11s %16llu %6.1f%% %14llu %12.1f", l, names[p], sum.cycles[l][p],
+		 100. * sum.cycles[l][p] / total, sum.calls[l][p], (double)sum.cycles[l][p] / sum.calls[l][p]);
+	os<<line<<std::endl;
+      }
+    }
+
+    bool hasEvents = false;
+    for(int l = 0; l < MAX_LEVELS; l++)
+      for(int p = 0; p < NB_PHASES; p++)
+	hasEvents = hasEvents || sum.events[l][p][PerfCounters::CYCLES] + sum.events[l][p][PerfCounters::INSTRUCTIONS] > 0;
+    if(! hasEvents) return;
+
+    PerfCounters &counters = PerfCounters::instance();
+    os<<"Hardware counters by phase (user space):"<<std::endl;
+    snprintf(line, sizeof(line), "%-6s %-11s", "level", "phase");
+    os<<line;
+    for(int k = 0; k < PerfCounters::NB_COUNTERS; k++){
+      snprintf(line, sizeof(line), " %14s", PerfCounters::name(k));
+      os<<line;
+    }
+    os<<"    IPC"<<std::endl;
+    for(int l = 0; l < MAX_LEVELS; l++)
+      for(int p = 0; p < NB_PHASES; p++){
+	if(sum.calls[l][p] == 0) continue;
+	const unsigned long long *e = sum.events[l][p];
+	snprintf(line, sizeof(line), "%-6d %-11s", l, names[p]);
+	os<<line;
+	for(int k = 0; k < PerfCounters::NB_COUNTERS; k++){
+	  if(counters.available(k))
+	    snprintf(line, sizeof(line), " %14llu", e[k]);
+	  else
+	    snprintf(line, sizeof(line), " %14s", "n/a");
+	  os<<line;
+	}
+	if(e[PerfCounters::CYCLES] > 0)
+	  snprintf(line, sizeof(line), " %6.2f", (double)e[PerfCounters::INSTRUCTIONS] / e[PerfCounters::CYCLES]);
+	else
+	  snprintf(line, sizeof(line), " %6s", "n/a");
+	os<<line<<std::endl;
+      }
+  }
+
+private:
+
+  PhaseTimers(){}
+  PhaseTimers(const PhaseTimers &) = delete;
+
+  inline std::shared_ptr<Table> registerThread(){
+    std::shared_ptr<Table> table(new Table);
+    std::lock_guard<std::mutex> lk(_mutex);
+    _tables.push_back(table);
+    return table;
+  }
+
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<Table>> _tables;
+};
+
+#ifdef NRPA_PHASE_TIMERS
+#define PHASE_LEVEL(level) PhaseTimers::Level phaseLevel_(level)
+#define PHASE_START(t) unsigned long long t = PhaseTimers::start()
+#define PHASE_LAP(t, phase) t = PhaseTimers::lap(t, PhaseTimers::phase)
+#define PHASE_SKIP(t) t = PhaseTimers::start()
+#define PHASE_RESET() PhaseTimers::instance().reset()
+#define PHASE_PRINT(os) PhaseTimers::instance().print(os)
+#else
+#define PHASE_LEVEL(level)
+#define PHASE_START(t)
+#define PHASE_LAP(t, phase)
+#define PHASE_SKIP(t)
+#define PHASE_RESET()
+#define PHASE_PRINT(os)
+#endif
+
+#endif //PHASETIMERS_HPP
@@ -0,0 +1,56 @@
+#!/usr/bin/gnuplot
+#
+# Plots the results of scaling.sh: speedup and parallel efficiency of the
+# throughput and of the time-to-target, by number of threads, one curve
+# per strategy and parallel level.
+#
+# Usage: gnuplot -e "dir='scaling'" plots/scaling.gp
+# writes <dir>/speedup.pdf, <dir>/efficiency.pdf, <dir>/throughput.pdf
+# and <dir>/time.pdf
+#
+# Columns of <dir>/strat<S>_level<L>.dat:
+#  1 strategy, 2 level, 3 threads, 4 playouts/s, 5 speedup, 6 efficiency,
+#  7 avg final score, 8 runs reaching target, 9 avg time to target,
+#  10 speedup, 11 efficiency
+
+if (!exists("dir")) dir = "scaling"
+
+files = system("ls ".dir."/strat*_level*.dat")
+title(f) = system("basename ".f." .dat | sed 's/strat\\([0-9]*\\)_level\\([0-9]*\\)/strategy \\1, level \\2/'")
+
+set terminal pdfcairo enhanced color
+set datafile missing "-"
+set logscale x 2
+set xlabel "Threads"
+set key top left
+set grid
+
+set out dir."/speedup.pdf"
+set title "Speedup"
+set ylabel "Speedup"
+set logscale y 2
+plot for [ f in files ] f u 3:5 w lp t title(f)." (playouts/s)", \
+     for [ f in files ] f u 3:10 w lp dt 2 t title(f)." (time to target)", \
+     x w l lc "gray" t "linear"
+unset logscale y
+
+set out dir."/efficiency.pdf"
+set title "Parallel efficiency"
+set ylabel "Efficiency"
+set yrange [0:*]
+set key bottom left
+plot for [ f in files ] f u 3:6 w lp t title(f)." (playouts/s)", \
+     for [ f in files ] f u 3:11 w lp dt 2 t title(f)." (time to target)", \
+     1 w l lc "gray" t "ideal"
+
+set out dir."/throughput.pdf"
+set title "Throughput"
+set ylabel "Playouts per second"
+set key top left
+plot for [ f in files ] f u 3:4 w lp t title(f)
+
+set out dir."/time.pdf"
+set title "Time to target"
+set ylabel "Time (s)"
+set logscale y
+plot for [ f in files ] f u 3:9 w lp t title(f)
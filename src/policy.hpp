@@ -3,6 +3,13 @@
 // Started on <2017-02-22 Wed>
 
 #ifndef POLICY_HPP
+#define POLICY_HPP
+
+#include <atomic>
+#include <climits>
+#include <cassert>
+#include <vector>
+#include <algorithm>
 
 #if 0 // if set to 1, use std hash map, otherwise, use the one from Tristan (faster so far). 
 class Policy{
@@ -46,6 +53,22 @@ public:
   }
 
 
+  /* Number of codes in the policy */ 
+  inline int size() const { return _probs.size(); }
+
+  /* Bytes used by the policy (approximate: nodes and buckets) */ 
+  inline size_t memory() const {
+    return sizeof(*this) + _probs.size() * (sizeof(std::pair<const int, double>) + sizeof(void *))
+      + _probs.bucket_count() * sizeof(void *); 
+  }
+
+  /* hist[k] = number of buckets that hold k codes, the last entry also
+     counts the longer chains */ 
+  inline void chainLengths(std::vector<long> &hist) const {
+    for(size_t b = 0; b < _probs.bucket_count(); b++)
+      hist[std::min(_probs.bucket_size(b), hist.size() - 1)]++; 
+  }
+
   inline void reset(){
     _probs.clear(); 
   }
@@ -122,8 +145,31 @@ class Policy {
     return 0.0;
   }
   
+  /* Number of codes in the policy (walks the whole table) */ 
+  inline int size() const {
+    int n = 0; 
+    for(int i = 0; i <= SizeTablePolicy; i++)
+      n += table[i].size(); 
+    return n; 
+  }
+
+  /* Bytes used by the bucket table and the codes it holds */ 
+  inline size_t memory() const {
+    size_t n = sizeof(*this); 
+    for(int i = 0; i <= SizeTablePolicy; i++)
+      n += table[i].capacity() * sizeof(ProbabilityCode); 
+    return n; 
+  }
+
+  /* hist[k] = number of buckets that hold k codes, the last entry also
+     counts the longer chains */ 
+  inline void chainLengths(std::vector<long> &hist) const {
+    for(int i = 0; i <= SizeTablePolicy; i++)
+      hist[std::min(table[i].size(), hist.size() - 1)]++; 
+  }
+
   inline void reset(){
-    for(int i = 0; i < SizeTablePolicy; i++){
+    for(int i = 0; i <= SizeTablePolicy; i++){
       table[i].clear(); 
     }
   }
@@ -133,5 +179,114 @@ class Policy {
 #endif 
 
 
+/* 
+ * Policy table that can be read and updated by many threads at once
+ * without any lock (used by the hogwild parallelization strategy).
+ *
+ * Open addressing over a fixed number of slots: a slot is claimed
+ * with a CAS the first time a code is updated and is only released by
+ * reset(). Weights are changed with relaxed atomic adds, so concurrent
+ * updates of the same weight are interleaved but never lost. A code
+ * that is not in the table has weight 0, as with Policy. 
+ */
+class AtomicPolicy {
+ public:
+  static const int SizeTable = 1 << 20; 
+
+  AtomicPolicy(): _nbUsed(0) {
+    for (int i = 0; i < SizeTable; i++) {
+      _codes [i].store (EmptyCode, std::memory_order_relaxed);
+      _probs [i].store (0.0, std::memory_order_relaxed);
+      _used [i].store (-1, std::memory_order_relaxed);
+    }
+  }
+
+  inline double prob (int code) const {
+    for (int i = hash (code), n = 0; n < SizeTable; i = (i + 1) & (SizeTable - 1), n++) {
+      int c = _codes [i].load (std::memory_order_relaxed);
+      if (c == code)
+	return _probs [i].load (std::memory_order_relaxed);
+      if (c == EmptyCode)
+	return 0.0;
+    }
+    return 0.0;
+  }
+
+  inline void updateProb (int code, double delta) {
+    for (int i = hash (code), n = 0; n < SizeTable; i = (i + 1) & (SizeTable - 1), n++) {
+      int c = _codes [i].load (std::memory_order_relaxed);
+      if (c == EmptyCode) {
+	if (_codes [i].compare_exchange_strong (c, code, std::memory_order_relaxed))
+	  _used [_nbUsed.fetch_add (1, std::memory_order_relaxed)].store (i, std::memory_order_release);
+	/* on failure, c holds the code that took the slot */
+      }
+      if (c == code || c == EmptyCode) {
+	double p = _probs [i].load (std::memory_order_relaxed);
+	while (!_probs [i].compare_exchange_weak (p, p + delta, std::memory_order_relaxed))
+	  ;
+	return;
+      }
+    }
+    std::cerr << "Error : AtomicPolicy is full (" << SizeTable << " codes)." << std::endl;
+    exit (1);
+  }
+
+  /* Number of distinct codes in the table */ 
+  inline int size () const {
+    return _nbUsed.load (std::memory_order_relaxed);
+  }
+
+  /* reset() and load() must not run concurrently with any other access */ 
+
+  inline void reset () {
+    int n = size ();
+    for (int j = 0; j < n; j++) {
+      int i = _used [j].load (std::memory_order_relaxed);
+      _codes [i].store (EmptyCode, std::memory_order_relaxed);
+      _probs [i].store (0.0, std::memory_order_relaxed);
+      _used [j].store (-1, std::memory_order_relaxed);
+    }
+    _nbUsed.store (0, std::memory_order_relaxed);
+  }
+
+  /* Replace the content of this table with the content of policy */ 
+  inline void load (const Policy &policy) {
+    reset ();
+    for (int i = 0; i <= SizeTablePolicy; i++)
+      for (int j = 0; j < policy.table [i].size (); j++)
+	updateProb (policy.table [i] [j].code, policy.table [i] [j].proba);
+  }
+
+  /* Replace the content of policy with the content of this table. It
+     may run concurrently with updateProb (snapshots of the hogwild
+     strategy at level > 1): a code counted by _nbUsed but whose slot is
+     not published yet (-1) is skipped, as if it came just after. */ 
+  inline void store (Policy &policy) const {
+    policy.reset ();
+    int n = size ();
+    for (int j = 0; j < n; j++) {
+      int i = _used [j].load (std::memory_order_acquire);
+      if (i < 0)
+	continue;
+      assert (_codes [i].load (std::memory_order_relaxed) != EmptyCode);
+      policy.setProb (_codes [i].load (std::memory_order_relaxed),
+		      _probs [i].load (std::memory_order_relaxed));
+    }
+  }
+
+ private:
+  static const int EmptyCode = INT_MIN;
+
+  static inline int hash (int code) {
+    return (static_cast<unsigned int> (code) * 2654435761u) >> 12; // top 20 bits
+  }
+
+  std::atomic<int> _codes [SizeTable];
+  std::atomic<double> _probs [SizeTable];
+  std::atomic<int> _used [SizeTable]; // slots in use (-1 = not published yet), for reset() and store()
+  std::atomic<int> _nbUsed;
+};
+
+
 #endif 
 
@@ -102,7 +102,6 @@ class Seen {
   }
 };
 
-static Move moves [MaxSize * MaxSize];
 
 int currentColor [MaxSize * MaxSize];
 int tabu, secondBest;
@@ -116,8 +115,10 @@ class Board {
   Move rollout [MaxPlayoutLength];
   int nbCellsColor [MaxColor], MaxCellsColor [MaxColor];
   unsigned long long hash;
+  Context *context;
 
   Board () {
+    context = &Context::current ();
     for (int i = 0; i < MaxSize * MaxSize; i++)
       color [i] = currentColor [i];
     for (int i = 0; i < MaxColor; i++) {
@@ -285,6 +286,15 @@ class Board {
     return false;
   }
 
+  void setContext (Context *c) {
+    context = c;
+  }
+
+  /* Moves found by findMoves (), one array per thread */
+  Move *scratchMoves () {
+    return context->scratch<Move> (MaxSize * MaxSize);
+  }
+
   bool moreThanOneMove (int c) {
     Seen seen;
     Move mv;
@@ -302,6 +312,7 @@ class Board {
   }
   
   void findMoves (int tabu = 9, int secondBest = 9) {
+    Move *moves = scratchMoves ();
     Seen seen;
     nbMoves = 0;
     seen.init ();
@@ -309,7 +320,7 @@ class Board {
     if (!moreThanOneMove (tabu))
       tabu = 9;
     /*
-    if ((!moreThanOneMove (secondBest)) || ((rand () % 10) > 9))
+    if ((!moreThanOneMove (secondBest)) || ((context->random () % 10) > 9))
       secondBest = 9;
     for (int i = 0; i < MaxSize * MaxSize; i++) 
       if ((color [i] != 9) && (color [i] != tabu) && (color [i] != secondBest))
@@ -449,7 +460,7 @@ class Board {
     /*
     if (length == 0) {
       allMoves = false;
-      double proba = (double)(rand () / (RAND_MAX + 1.0));
+      double proba = (double)(context->random () / (RAND_MAX + 1.0));
       if (proba < epsilon) {
 	allMoves = true;
 	//findMoves (mvs, 9, 9, true);
@@ -528,6 +539,7 @@ class Board {
   }
 
   void findMovesColor (int c) {
+    Move *moves = scratchMoves ();
     Seen seen;
     nbMoves = 0;
     seen.init ();
@@ -590,17 +602,19 @@ class Board {
   }
 
   void playout () {
+    Move *moves = scratchMoves ();
     secondBest = 9;
     tabu = bestColor (secondBest);
     findMoves (tabu, secondBest);
     while (nbMoves > 0) {
-      int index = nbMoves * (rand () / (RAND_MAX + 1.0));
+      int index = nbMoves * (context->random () / (RAND_MAX + 1.0));
       play (moves [index]);
       findMoves (tabu, secondBest);
     }
   }
 
   int evaluation () {
+    Move *moves = scratchMoves ();
     findMoves ();
     int score = 0;
     for (int i = 0; i < nbMoves; i++) {
@@ -645,7 +659,7 @@ class Board {
 	proba [i] = 0.0;
       sumProbas += proba [i];
     }
-    float r = sumProbas * (rand () / (RAND_MAX + 1.0));
+    float r = sumProbas * (context->random () / (RAND_MAX + 1.0));
     float s = 0.0;
     for (int i = 0; i < maxColor; i++) {
       s += proba [i];
@@ -656,12 +670,13 @@ class Board {
   }
 
   void playoutColored () {
+    Move *moves = scratchMoves ();
     secondBest = 9;
     tabu = bestColor (secondBest);
     int color = chooseColor (tabu);
     findMovesColor (color);
     while (nbMoves > 0) {
-      int index = nbMoves * (rand () / (RAND_MAX + 1.0));
+      int index = nbMoves * (context->random () / (RAND_MAX + 1.0));
       play (moves [index]);
       color = chooseColor (tabu);
       findMovesColor (color);
@@ -678,7 +693,7 @@ class Board {
     Seen seen;
     Move m;
     while (nbLocs > 0) {
-      int index = nbLocs * (rand () / (RAND_MAX + 1.0));
+      int index = nbLocs * (context->random () / (RAND_MAX + 1.0));
       buildMove (loc [index], seen, m);
       if (m.nbLocations > 1)
 	break;
@@ -695,7 +710,7 @@ class Board {
 	  nbLocs++;
 	}
       while (nbLocs > 0) {
-	int index = nbLocs * (rand () / (RAND_MAX + 1.0));
+	int index = nbLocs * (context->random () / (RAND_MAX + 1.0));
 	buildMove (loc [index], seen, m);
 	if (m.nbLocations > 1)
 	  break;
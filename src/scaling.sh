@@ -0,0 +1,161 @@
+#!/bin/bash
+# scaling.sh
+# Thread scaling of the parallelization strategies.
+#
+# Each configuration (strategy, parallel level, number of threads) is run
+# with iteration statistics (-s) and live metrics (-M): the throughput is
+# the number of playouts of the metrics file per second of wall time, the
+# time-to-score is computed from the iteration stats file as in
+# bench_strats.sh. Speedups and parallel efficiencies are relative to the
+# smallest number of threads of the same strategy and parallel level.
+#
+# Usage: see ./scaling.sh (without any argument).
+#
+
+usage () {
+cat << EOS
+./scaling.sh [-x "<threads>"] [-p "<levels>"] [-s "<strategies>"] [-t <target>] [-o <dir>] <binary> <standard_nrpa_arguments>
+ Where:
+    -x "<threads>" is the list of numbers of threads (default: "1 2 4 8 16 32 64").
+
+    -p "<levels>" is the list of parallel levels (default: "1").
+
+    -s "<strategies>" is the list of strategies (default: "1 3").
+
+    -t <target> is the score to reach. By default, the lowest average
+    final score among all configurations is used, so that every
+    configuration has a chance to reach it.
+
+    -o <dir> is where the results are written (default: scaling):
+      <dir>/scaling.dat, one line per configuration, see its header;
+      <dir>/strat<S>_level<L>.dat, the same lines for each strategy S
+      and parallel level L, to be plotted with plots/scaling.gp:
+        gnuplot -e "dir='<dir>'" plots/scaling.gp
+
+    <binary> is any nrpa executable (e.g. ./same or test/tsptw).
+
+    <standard_nrpa_arguments> can be any argument supported by nrpa,
+    except --num-thread (-x), --parallel-level (-p), --parallel-strat (-P),
+    --iter-stats (-s), --tag (-T), --statfile-prefix (-f) and
+    --metrics-file (-M) which are set by this script. Use a fixed number of
+    iterations (-l, -n) rather than a timeout, so that the configurations
+    do the same search.
+EOS
+}
+
+THREADS="1 2 4 8 16 32 64"
+LEVELS="1"
+STRATS="1 3"
+TARGET=""
+DIR=scaling
+
+while [[ "$1" == \-* ]]; do
+    case $1 in
+	-x ) shift
+	     THREADS=$1
+	     ;;
+	-p ) shift
+	     LEVELS=$1
+	     ;;
+	-s ) shift
+	     STRATS=$1
+	     ;;
+	-t ) shift
+	     TARGET=$1
+	     ;;
+	-o ) shift
+	     DIR=$1
+	     ;;
+	* )  usage
+	     exit 1
+	     ;;
+    esac
+    shift
+done
+
+if [ $# -lt 1 ]; then
+    usage;
+    exit 1;
+fi
+
+BIN=$1
+shift
+REST=$*
+
+TMP=$(mktemp -d)
+PREFIX=$TMP/nrpa_stats
+declare -A STATFILE
+declare -A RATE
+
+for s in $STRATS; do
+    for p in $LEVELS; do
+	for x in $THREADS; do
+	    c=s${s}_p${p}_x${x}
+	    echo "Running $BIN $REST -x $x -p $p -P $s -s -f $PREFIX -T $c -M $TMP/$c.prom" >&2
+	    start=$(date +%s.%N)
+	    STATFILE[$c]=$($BIN $REST -x $x -p $p -P $s -s -f $PREFIX -T $c -M $TMP/$c.prom -E 3600 | grep "Iter stats filename" | head -n 1 | cut -d ':' -f 2 | tr -d ' ')
+	    end=$(date +%s.%N)
+	    if [ -z "${STATFILE[$c]}" ] || [ ! -f "${STATFILE[$c]}" ] || [ ! -f $TMP/$c.prom ]; then
+		echo "Error: no statistics for strategy $s, parallel level $p, $x threads." >&2
+		rm -rf $TMP
+		exit 1
+	    fi
+	    RATE[$c]=$(awk -v start=$start -v end=$end '$1 == "nrpa_playouts_total" { printf "%.1f", $2 / (end - start) }' $TMP/$c.prom)
+	done
+    done
+done
+
+# average final score of a stat file
+final_score () {
+    awk '/^[^#]/ && NF >= 4 { last[$1] = $4 }
+         END { for(r in last) { sum += last[r]; n++ } if(n > 0) print sum / n }' $1
+}
+
+# <avgfinalscore> <nbrunsreachingtarget>/<nbruns> <avgtimetotarget> of a stat file
+time_to_target () {
+    awk -v target=$TARGET \
+	'/^[^#]/ && NF >= 4 { runs[$1] = 1; last[$1] = $4;
+                              if(!($1 in reached) && $4 >= target) reached[$1] = $3 }
+         END { for(r in runs) { n++; sum += last[r] }
+               for(r in reached) { k++; tsum += reached[r] }
+               printf "%.2f %d/%d %s\n", sum / n, k, n, (k > 0 ? sprintf("%.3f", tsum / k) : "-") }' $1
+}
+
+if [ -z "$TARGET" ]; then
+    TARGET=$(for c in ${!STATFILE[@]}; do final_score ${STATFILE[$c]}; done | sort -g | head -n 1)
+fi
+
+mkdir -p $DIR
+rm -f $DIR/strat*_level*.dat
+HEADER="#<strategy> <level> <threads> <playouts/s> <speedup> <efficiency> <avgfinalscore> <nbrunsreachingtarget>/<nbruns> <avgtimetotarget> <speedup> <efficiency>"
+{
+    echo "# $BIN $REST"
+    echo "# target score: $TARGET"
+    echo "$HEADER"
+    for s in $STRATS; do
+	for p in $LEVELS; do
+	    # reference: the first (smallest) number of threads
+	    x0=""
+	    for x in $THREADS; do
+		c=s${s}_p${p}_x${x}
+		read score reached time <<< $(time_to_target ${STATFILE[$c]})
+		if [ -z "$x0" ]; then
+		    x0=$x
+		    rate0=${RATE[$c]}
+		    time0=$time
+		fi
+		awk -v s=$s -v p=$p -v x=$x -v x0=$x0 -v r=${RATE[$c]} -v r0=$rate0 \
+		    -v score=$score -v reached=$reached -v t=$time -v t0=$time0 \
+		    'BEGIN { printf "%s %s %s %.1f %.2f %.2f %s %s %s", s, p, x, r, r / r0, (r / r0) * x0 / x, score, reached, t;
+		             if(t != "-" && t0 != "-" && t > 0) printf " %.2f %.2f\n", t0 / t, (t0 / t) * x0 / x;
+		             else printf " - -\n" }' | tee -a $DIR/strat${s}_level${p}.dat
+	    done
+	done
+    done
+} > $DIR/scaling.dat
+
+# tables: throughput and time-to-target of each strategy and level, by number of threads
+column -t $DIR/scaling.dat 2> /dev/null || cat $DIR/scaling.dat
+echo "# results written in $DIR, plot them with: gnuplot -e \"dir='$DIR'\" $(dirname $0)/plots/scaling.gp"
+
+rm -rf $TMP
@@ -12,28 +12,20 @@
 #include <iomanip> 
 
 #include "cli.hpp"
+#include "statstream.hpp"
 
+/* Statistics of the runs of a search engine (NRPA = Nrpa or Nmcs), the
+   engine gives the best score found so far with bestScore(). Events
+   are kept in memory for writeStats(), and also appended to the
+   StatStream when it is open (--stats-stream). */ 
 template <typename NRPA> 
 class Stats{
 
-  static const int MAX_RUNS = 32; 
-  static const int MAX_ITER = 128;  // maximum number of iteration (used for iteration-based stat collection) 
-  static const int MAX_TIME_EVENTS = 32;  // maximum number of timer events (used for time-based stat collection)
+  static const int MAX_TIME_EVENTS = 32;  // timer events are 2^i seconds after the start of a run
 
   
 public: 
 
-  struct NrpaStats{
-    NrpaStats(); 
-    void prettyPrint(); 
-
-    float date; 
-    int iter; 
-    int eventIdx; 
-    double bestScore;
-
-  }; 
-  
   Stats();
 
   void initIterStats();
@@ -42,11 +34,27 @@ public:
   void startRun(NRPA *nrpa, int timeout = 0); 
   void finishRun(); 
 
-  void recordIterStats(int iter, const typename NRPA::NrpaLevel &nl); 
-  void recordTimerStats(const typename NRPA::NrpaLevel &nl); 
+  void recordIterStats(int iter, double bestScore); 
+  void recordTimerStats(double bestScore); 
 
   void writeStats(const std::string &prefix, const Options &o) const; 
 
+  /* Store the first run of o as run runId of this object */ 
+  void copyRun(int runId, const Stats &o); 
+
+  /* Parallel rounds: duration of the round and sum over the workers of
+     the time spent waiting for the slowest one (in seconds) */ 
+  struct RoundStats{
+    long nbRounds; 
+    long nbTasks; 
+    double roundTime; 
+    double idleTime; 
+    double workerTime; 
+  }; 
+  void recordRound(double roundTime, double idleTime, int nbWorkers, int nbTasks); 
+  RoundStats roundStats() const { return _rounds; }
+  void printRoundStats(std::ostream &os) const; 
+
   float getTime() const; 
 
   bool timeout() const;
@@ -55,6 +63,7 @@ public:
 private:
 
   void setTimers(); 
+  static StatEvent event(char kind, int index, float date, double bestScore); 
 
   std::chrono::system_clock::time_point _startTime; 
 
@@ -62,12 +71,10 @@ private:
   bool _timerStatsOn;
 
   int _runId; 
+  int _streamRunId; // id of the current run in the StatStream
 
-  int _runNbIter[MAX_RUNS]; 
-  int _runNbEvents[MAX_RUNS]; 
-
-  NrpaStats _iterStats[MAX_RUNS][MAX_ITER]; // stastics collected at each top level iteration 
-  NrpaStats _timerStats[MAX_RUNS][MAX_TIME_EVENTS]; // stastics collected on time events
+  StatRuns _iterStats;  // stastics collected at each top level iteration, for each run
+  StatRuns _timerStats; // stastics collected on time events, for each run
 
   atomic_bool _done; 
   std::mutex _doneMutex; 
@@ -78,6 +85,8 @@ private:
 
   int _timeout; 
 
+  RoundStats _rounds; 
+
   NRPA *_nrpa; 
   thread *_thread; 
 }; 
@@ -86,7 +95,11 @@ private:
 template <typename NRPA>
 Stats<NRPA>::Stats():
   _iterStatsOn(false),
-  _timerStatsOn(false){
+  _timerStatsOn(false),
+  _runId(0),
+  _streamRunId(-1),
+  _done(false),
+  _rounds(){
 }
 
 template <typename NRPA>
@@ -105,17 +118,21 @@ void Stats<NRPA>::startRun(NRPA *nrpa, int timeout){
   _nrpa = nrpa; 
   _timeout = timeout; 
   _done = false; 
+  _startTime = system_clock::now(); // dates of iteration stats are relative to this
 
   if(_iterStatsOn){
-    fill_n(_iterStats[_runId], MAX_ITER, NrpaStats()); // reset stats
-    _runNbIter[_runId] = 0;
+    _iterStats.resize(_runId + 1); 
+    _iterStats[_runId].clear(); 
   }
 
   if(_timerStatsOn){
-    fill_n(_timerStats[_runId], MAX_TIME_EVENTS, NrpaStats()); // reset stats  
-    _runNbEvents[_runId] = 0;
+    _timerStats.resize(_runId + 1); 
+    _timerStats[_runId].clear(); 
   }
 
+  StatStream &stream = StatStream::instance(); 
+  _streamRunId = stream.isOpen() ? stream.newRun() : -1; 
+
   if(_timerStatsOn || _timeout > 0)
     setTimers(); 
 }
@@ -150,27 +167,26 @@ void Stats<NRPA>::finishRun(){
 }
 
 template <typename NRPA>
-void Stats<NRPA>::recordIterStats(int iter, const typename NRPA::NrpaLevel &nl){
-  if(_iterStatsOn){
-    assert(iter == _runNbIter[_runId]); 
+void Stats<NRPA>::recordIterStats(int iter, double bestScore){
+  if(!_iterStatsOn && _streamRunId < 0) return; 
 
-    float date = getTime(); 
-    _iterStats[_runId][iter].date =  date; 
-    _iterStats[_runId][iter].bestScore = nl.bestRollout.score(); 
-
-    _runNbIter[_runId]++;
+  float date = getTime(); 
+  if(_iterStatsOn){
+    assert(iter == (int)_iterStats[_runId].size()); 
+    _iterStats[_runId].push_back(event(StatEvent::ITER, iter, date, bestScore)); 
   }
+  if(_streamRunId >= 0)
+    StatStream::instance().record(StatEvent::ITER, _streamRunId, iter, date, bestScore); 
 }
 
 template <typename NRPA>
-void Stats<NRPA>::recordTimerStats(const typename NRPA::NrpaLevel &nl){
+void Stats<NRPA>::recordTimerStats(double bestScore){
   if(_timerStatsOn){
-    int eventIdx = _runNbEvents[_runId];
-    _timerStats[_runId][eventIdx].date = getTime(); 
-    _timerStats[_runId][eventIdx].bestScore = nl.bestRollout.score(); 
-    _timerStats[_runId][eventIdx].eventIdx = eventIdx;
-
-    _runNbEvents[_runId]++;
+    int eventIdx = _timerStats[_runId].size();
+    float date = getTime(); 
+    _timerStats[_runId].push_back(event(StatEvent::TIMER, eventIdx, date, bestScore)); 
+    if(_streamRunId >= 0)
+      StatStream::instance().record(StatEvent::TIMER, _streamRunId, eventIdx, date, bestScore); 
   }
 }
 
@@ -180,8 +196,6 @@ void Stats<NRPA>::writeStats(const string &prefix, const Options &o) const{
   if( ! ( _iterStatsOn || _timerStatsOn ) ) return ; 
 
   fstream fs;
-  fs << fixed;
-  fs << setprecision(2);
 
   ostringstream filename;
 
@@ -189,6 +203,9 @@ void Stats<NRPA>::writeStats(const string &prefix, const Options &o) const{
   filename<<"_level."<<o.numLevel;
   filename<<"_nbIter."<<o.numIter;
 
+  ostringstream header; 
+  o.print(header, "# "); 
+
   if(_iterStatsOn){
     ostringstream iterfilename; 
     iterfilename<<filename.str()<<".iter.dat"; 
@@ -196,17 +213,9 @@ void Stats<NRPA>::writeStats(const string &prefix, const Options &o) const{
       iterfilename<<"."<<o.tag;
     
     fs.open(iterfilename.str(), fstream::out);
-    o.print(fs, "# "); 
-    fs<<"#<RunId> <iterId> <timestamp> <currentbestscore>"<<"\n";
-    //fs<<"# nbRun "<<nbRun<<" level "<<level<<" nbIter "<<nbIter<<" timeout "<<timeout<<" nbThreads "<<nbThreads<<endl;
-    for(int i = 0; i < _runId; i++){
-      for(int j = 0; j < _runNbIter[i]; j++){
-	const NrpaStats &s = _iterStats[i][j]; 
-	fs<<i<<" "<<j<<" "<<s.date<<" "<<s.bestScore<<" "<<"\n";
-      }
-      fs<<"\n\n"; 
+    StatStream::writeIterDat(fs, header.str(), _iterStats); 
+    for(int i = 0; i < _runId; i++)
       cout<<"Iter stats filename: "<<iterfilename.str()<<endl;
-    }
     fs.close(); 
   }
 
@@ -217,31 +226,49 @@ void Stats<NRPA>::writeStats(const string &prefix, const Options &o) const{
       timerfilename<<"."<<o.tag;
 
     fs.open(timerfilename.str(), fstream::out);
-    //fs<<"# nbRun "<<nbRun<<" level "<<level<<" nbIter "<<nbIter<<" timeout "<<timeout<<" nbThreads "<<nbThreads<<endl;
-    o.print(fs, "# "); 
-    fs<<"#<RunId> <timereventid> <timestamp> <currentbestscore>"<<"\n";
-    int maxNbEvents = 0; 
-    for(int i = 0; i < _runId; i++)
-      maxNbEvents = max(maxNbEvents, _runNbEvents[i]); 
-
-    for(int i = 0; i < _runId; i++){
-      for(int j = 0; j < maxNbEvents; j++){
-	if(j < _runNbEvents[i]){
-	  const NrpaStats &s = _timerStats[i][j]; 
-	  fs<<i<<" "<<j<<" "<<s.date<<" "<<s.bestScore<<" "<<"\n";
-	}
-	else{
-	  const NrpaStats &s = _timerStats[i][_runNbEvents[i] - 1]; 
-	  fs<<i<<" "<<j<<" "<<s.date<<" "<<s.bestScore<<" "<<"\n";
-	}
-      }
-      fs<<"\n\n"; 
-    }
+    StatStream::writeTimerDat(fs, header.str(), _timerStats); 
     fs.close();
     cout<<"Timer stats filename: "<<timerfilename.str()<<endl;
   }
 }
 
+template <typename NRPA>
+void Stats<NRPA>::copyRun(int runId, const Stats &o){
+  if(_iterStatsOn){
+    if((int)_iterStats.size() <= runId) _iterStats.resize(runId + 1); 
+    _iterStats[runId] = o._iterStats[0]; 
+  }
+  if(_timerStatsOn){
+    if((int)_timerStats.size() <= runId) _timerStats.resize(runId + 1); 
+    _timerStats[runId] = o._timerStats[0]; 
+  }
+  _runId = max(_runId, runId + 1); 
+
+  _rounds.nbRounds += o._rounds.nbRounds; 
+  _rounds.nbTasks += o._rounds.nbTasks; 
+  _rounds.roundTime += o._rounds.roundTime; 
+  _rounds.idleTime += o._rounds.idleTime; 
+  _rounds.workerTime += o._rounds.workerTime; 
+}
+
+template <typename NRPA>
+void Stats<NRPA>::recordRound(double roundTime, double idleTime, int nbWorkers, int nbTasks){
+  _rounds.nbRounds++; 
+  _rounds.nbTasks += nbTasks; 
+  _rounds.roundTime += roundTime; 
+  _rounds.idleTime += idleTime; 
+  _rounds.workerTime += roundTime * nbWorkers; 
+}
+
+template <typename NRPA>
+void Stats<NRPA>::printRoundStats(std::ostream &os) const{
+  const RoundStats &r = _rounds; 
+  if(r.nbRounds == 0) return; 
+  os<<"Parallel rounds: "<<r.nbRounds
+    <<", average round duration: "<<r.roundTime / r.nbRounds * 1000<<"ms"
+    <<", idle time: "<<(r.workerTime > 0 ? r.idleTime / r.workerTime * 100 : 0)<<"% of worker time."<<endl; 
+}
+
 template <typename NRPA>
 void Stats<NRPA>::setTimers(){
   using namespace chrono;
@@ -268,7 +295,7 @@ void Stats<NRPA>::setTimers(){
       int i; 
       for(i = 0; i <= _lastEventIdx; i++){
   	_doneCond.wait_until(lk, _startTime + seconds(timerEvents[i]));
-	recordTimerStats(_nrpa->_nrpa[_nrpa->_startLevel]);
+	recordTimerStats(_nrpa->bestScore());
 	if(_done) break; // nrpa has terminated normally
       }
       if( i > _lastEventIdx) { //timeout!
@@ -281,9 +308,15 @@ void Stats<NRPA>::setTimers(){
 
 
 template <typename NRPA>
-Stats<NRPA>::NrpaStats::NrpaStats(): bestScore(numeric_limits<double>::lowest()),
-				     iter(0), 
-				     date(0){}
+StatEvent Stats<NRPA>::event(char kind, int index, float date, double bestScore){
+  StatEvent e; 
+  memset(&e, 0, sizeof(e)); 
+  e.kind = kind; 
+  e.index = index; 
+  e.date = date; 
+  e.bestScore = bestScore; 
+  return e; 
+}
 
 
 #endif //STATS_HPP
@@ -0,0 +1,195 @@
+// statstream.hpp
+// Append-only stream of the statistics events of the runs, and the
+// gnuplot .dat layout shared by Stats and stream2dat.
+
+#ifndef STATSTREAM_HPP
+#define STATSTREAM_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <algorithm>
+
+/* One statistics event: the best score of a run at some date */
+struct StatEvent{
+  char kind;       // ITER or TIMER
+  char pad[3];
+  int32_t runId;
+  int32_t index;   // iteration of the start level, or timer event
+  float date;      // seconds since the start of the run
+  double bestScore;
+
+  static const char ITER = 'i';
+  static const char TIMER = 't';
+};
+static_assert(sizeof(StatEvent) == 24, "binary stat streams need 24 bytes events");
+
+/* Events of each run, index by run id */
+typedef std::vector<std::vector<StatEvent>> StatRuns;
+
+/*
+ * Events are appended to the stream file as they are recorded, and
+ * flushed at once, so the file can be tailed during a search and is
+ * complete up to the last event if the process dies.
+ *
+ * Text streams start with the options as '# ' lines, then one line per
+ * event:
+ *   <kind> <runId> <index> <timestamp> <bestscore>
+ * Binary streams start with magic(), the length of the options text
+ * (uint32) and the options text, then StatEvent records.
+ *
+ * stream2dat converts a stream (of either kind) to the .iter.dat and
+ * .timer.dat files written by Stats at exit.
+ */
+class StatStream{
+
+public:
+
+  /* First bytes of binary streams */
+  static inline const char *magic(){ return "NRPASTA1"; }
+
+  static inline StatStream &instance(){
+    static StatStream stream;
+    return stream;
+  }
+
+  inline bool isOpen() const { return _file != nullptr; }
+
+  /* header is written at the top of the stream (e.g. the options) */
+  inline bool open(const std::string &filename, bool binary, const std::string &header){
+    close();
+    _file = fopen(filename.c_str(), binary ? "wb" : "w");
+    if(!_file) return false;
+    _binary = binary;
+    _nbRuns = 0;
+    if(binary){
+      uint32_t length = header.size();
+      fwrite(magic(), 1, strlen(magic()), _file);
+      fwrite(&length, sizeof(length), 1, _file);
+      fwrite(header.data(), 1, length, _file);
+    }
+    else
+      fputs(header.c_str(), _file);
+    fflush(_file);
+    return true;
+  }
+
+  inline void close(){
+    if(_file) fclose(_file);
+    _file = nullptr;
+  }
+
+  /* Id of a new run, runs are numbered in the order they start */
+  inline int newRun(){ return _nbRuns++; }
+
+  inline void record(char kind, int runId, int index, float date, double bestScore){
+    if(!_file) return;
+    StatEvent e;
+    memset(&e, 0, sizeof(e));
+    e.kind = kind; e.runId = runId; e.index = index; e.date = date; e.bestScore = bestScore;
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    if(_binary)
+      fwrite(&e, sizeof(e), 1, _file);
+    else
+      fprintf(_file, "%c %d %d %.9g %.17g\n", kind, runId, index, date, bestScore); // exact, rounded once by stream2dat
+    fflush(_file);
+  }
+
+  /* Read a stream written by record(), events are stored by run and
+     kind, header gets the options text. Returns false if the file
+     cannot be read. */
+  static inline bool read(const std::string &filename, StatRuns &iter, StatRuns &timer, std::string &header){
+    FILE *f = fopen(filename.c_str(), "rb");
+    if(!f) return false;
+
+    char head[8];
+    size_t n = fread(head, 1, sizeof(head), f);
+    if(n == sizeof(head) && memcmp(head, magic(), sizeof(head)) == 0){
+      uint32_t length;
+      if(fread(&length, sizeof(length), 1, f) != 1){ fclose(f); return false; }
+      header.resize(length);
+      if(length > 0 && fread(&header[0], 1, length, f) != length){ fclose(f); return false; }
+      StatEvent e;
+      while(fread(&e, sizeof(e), 1, f) == 1) // a truncated last record is dropped
+	add(e, iter, timer);
+    }
+    else{
+      rewind(f);
+      char line[1024];
+      while(fgets(line, sizeof(line), f)){
+	if(line[0] == '#'){
+	  header += line;
+	  continue;
+	}
+	StatEvent e;
+	memset(&e, 0, sizeof(e));
+	if(sscanf(line, "%c %d %d %f %lf", &e.kind, &e.runId, &e.index, &e.date, &e.bestScore) == 5)
+	  add(e, iter, timer);
+      }
+    }
+    fclose(f);
+    return true;
+  }
+
+  /* Iteration statistics in the .iter.dat layout */
+  static inline void writeIterDat(std::ostream &os, const std::string &header, const StatRuns &runs){
+    os<<std::fixed<<std::setprecision(2);
+    os<<header;
+    os<<"#<RunId> <iterId> <timestamp> <currentbestscore>"<<"\n";
+    for(size_t i = 0; i < runs.size(); i++){
+      for(size_t j = 0; j < runs[i].size(); j++){
+	const StatEvent &s = runs[i][j];
+	os<<i<<" "<<j<<" "<<s.date<<" "<<s.bestScore<<" "<<"\n";
+      }
+      os<<"\n\n";
+    }
+  }
+
+  /* Timer statistics in the .timer.dat layout: every run has the same
+     number of events, runs that stopped early repeat their last one */
+  static inline void writeTimerDat(std::ostream &os, const std::string &header, const StatRuns &runs){
+    os<<std::fixed<<std::setprecision(2);
+    os<<header;
+    os<<"#<RunId> <timereventid> <timestamp> <currentbestscore>"<<"\n";
+    size_t maxNbEvents = 0;
+    for(size_t i = 0; i < runs.size(); i++)
+      maxNbEvents = std::max(maxNbEvents, runs[i].size());
+
+    for(size_t i = 0; i < runs.size(); i++){
+      for(size_t j = 0; j < maxNbEvents && !runs[i].empty(); j++){
+	const StatEvent &s = runs[i][std::min(j, runs[i].size() - 1)];
+	os<<i<<" "<<j<<" "<<s.date<<" "<<s.bestScore<<" "<<"\n";
+      }
+      os<<"\n\n";
+    }
+  }
+
+private:
+
+  StatStream(): _file(nullptr), _binary(false), _nbRuns(0){}
+  StatStream(const StatStream &) = delete;
+  ~StatStream(){ close(); }
+
+  static inline void add(const StatEvent &e, StatRuns &iter, StatRuns &timer){
+    if(e.runId < 0) return;
+    StatRuns &runs = e.kind == StatEvent::TIMER ? timer : iter;
+    if((int)runs.size() <= e.runId) runs.resize(e.runId + 1);
+    runs[e.runId].push_back(e);
+  }
+
+  FILE *_file;
+  bool _binary;
+  std::atomic<int> _nbRuns;
+  std::mutex _mutex;
+};
+
+#endif //STATSTREAM_HPP
@@ -0,0 +1,41 @@
+// stream2dat.cpp
+// Convert a statistics stream (--stats-stream) to the .dat files of plots/.
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "statstream.hpp"
+
+using namespace std;
+
+int main(int argc, char *argv[]){
+
+  if(argc != 3){
+    cerr<<"Usage: "<<argv[0]<<" <stream> <prefix>"<<endl;
+    cerr<<"\tWrite the events of <stream> (text or binary) to <prefix>.iter.dat"<<endl;
+    cerr<<"\tand <prefix>.timer.dat, in the layout written by --iter-stats and"<<endl;
+    cerr<<"\t--timer-stats (see plots/plot_all.gp)."<<endl;
+    return 1;
+  }
+
+  StatRuns iter, timer;
+  string header;
+  if(!StatStream::read(argv[1], iter, timer, header)){
+    cerr<<"Error : cannot read "<<argv[1]<<"."<<endl;
+    return 1;
+  }
+
+  string prefix = argv[2];
+  if(!iter.empty()){
+    ofstream ofs(prefix + ".iter.dat");
+    StatStream::writeIterDat(ofs, header, iter);
+    cout<<"Iter stats filename: "<<prefix<<".iter.dat"<<endl;
+  }
+  if(!timer.empty()){
+    ofstream ofs(prefix + ".timer.dat");
+    StatStream::writeTimerDat(ofs, header, timer);
+    cout<<"Timer stats filename: "<<prefix<<".timer.dat"<<endl;
+  }
+  return 0;
+}
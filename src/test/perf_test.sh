@@ -0,0 +1,209 @@
+#!/bin/bash
+
+# perf_test.sh
+# Throughput regression test: run the command on the first line of a
+# baseline file and compare its speed with the one stored in the file.
+
+tolerance=25
+slack=0.05
+repeats=3
+create_test=""
+quiet=""
+
+usage="Usage: $0 [-e <tolerance>] [-a <slack>] [-n <repeats>] [-q] <baseline_file>\n
+Execute the command line on the first line of baseline_file (an nrpa\n
+command with a fixed seed, e.g. -x 1 -a 1 -r 1) and compare its speed\n
+with the baseline stored in the rest of the file.\n\n
+
+Measures (the best of <repeats> executions is kept):\n
+ playouts_per_second: playouts (from --metrics-file) per second of wall time.\n
+ time_to_score <score> <sec>: time at which the best score of the run\n
+   reaches <score> (from --stats-stream).\n
+The number of playouts and the final score must be the ones of the\n
+baseline: the search itself must not have changed.\n\n
+
+Options: \n
+ -e <tolerance>: accepted slow down, in percent (default: $tolerance)\n
+ -a <slack>: accepted slow down of the times to score, in seconds, on top of the tolerance (default: $slack)\n
+ -n <repeats>: executions of the command (default: $repeats)\n
+ -q: only print the result\n
+ -c: create the baseline instead. See 'Adding a baseline' section\n\n
+
+Adding a baseline:\n
+  Usage: $0 -c [-n <repeats>] <baseline_file> <command> \n
+  Run <command> and store its speed in baseline_file. Baselines depend\n
+  on the machine, regenerate them (make gen-perf-test) on the machine\n
+  that runs the tests.\n
+"
+
+# parse options, shift until $1 doesn't start with a dash
+while [[ "$1" == \-* ]]; do
+    case $1 in
+	-e | --tolerance )      shift
+				tolerance=$1
+				;;
+	-a | --slack )          shift
+				slack=$1
+				;;
+	-n | --repeats )        shift
+				repeats=$1
+				;;
+	-c | --create-test )    create_test=1
+				;;
+	-q | --quiet )          quiet=1
+				;;
+	* )           echo "Error: unexpected $1."
+		      echo -e $usage
+		      exit 1
+		      ;;
+    esac
+    shift
+done
+
+if [ $# -lt 1 ]; then
+    echo -e $usage
+    exit 1
+fi
+
+test_file=$1
+shift
+
+if [ ! -z "$create_test" ]; then
+    command="$*"
+else
+    command=$(head -q -n 1 $test_file)
+fi
+
+if [ -z "$command" ]; then
+    echo -e $usage
+    exit 1
+fi
+
+tmp=$(mktemp -d)
+trap "rm -rf $tmp" EXIT
+
+# floating point arithmetic: calc <expression>, test <condition>
+calc () {
+    awk "BEGIN { printf \"%.6f\", $* }"
+}
+test_fp () {
+    awk "BEGIN { exit !($*) }"
+}
+
+# run the command once, print: <playouts> <seconds> <finalscore>, and
+# keep the iteration events of its first run in $tmp/events (<timestamp> <bestscore>)
+run_once () {
+    rm -f $tmp/metrics $tmp/stream
+    local start=$(date +%s.%N)
+    $command -M $tmp/metrics -E 3600 -y $tmp/stream > $tmp/out 2>&1
+    local ret=$?
+    local end=$(date +%s.%N)
+    if [ $ret -ne 0 ] || [ ! -f $tmp/metrics ] || [ ! -f $tmp/stream ]; then
+	echo "$0: Error, '$command' failed, see its output:" >&2
+	tail -n 5 $tmp/out >&2
+	exit 1
+    fi
+    awk '$1 == "i" && $2 == 0 { print $4, $5 }' $tmp/stream > $tmp/events
+    local playouts=$(awk '$1 == "nrpa_playouts_total" { print $2 }' $tmp/metrics)
+    local score=$(awk -F': ' '/^Bestscore-overall:/ { print $2 }' $tmp/out)
+    echo $playouts $(calc "$end - $start") $score
+}
+
+# first time at which the events reach a score (empty if never)
+time_to_score () {
+    awk -v s=$1 '$2 >= s { print $1; exit }' $tmp/events
+}
+
+# measure the command $repeats times: best rate and best time to each threshold
+measure () {
+    best_rate=""
+    declare -gA best_time
+    for t in $thresholds; do best_time[$t]=""; done
+    for r in $(seq $repeats); do
+	read playouts seconds score <<< $(run_once)
+	[ -z "$playouts" ] && exit 1
+	rate=$(calc "$playouts / $seconds")
+	if [ -z "$best_rate" ] || test_fp "$rate > $best_rate"; then
+	    best_rate=$rate
+	fi
+	for t in $thresholds; do
+	    tt=$(time_to_score $t)
+	    if [ ! -z "$tt" ] && { [ -z "${best_time[$t]}" ] || test_fp "$tt < ${best_time[$t]}"; }; then
+		best_time[$t]=$tt
+	    fi
+	done
+    done
+}
+
+if [ ! -z "$create_test" ]; then
+    thresholds=""
+    read playouts seconds score <<< $(run_once)
+    [ -z "$playouts" ] && exit 1
+    # thresholds: the best scores after a quarter, half, three quarters and all of the iterations
+    thresholds=$(awk '{ s[NR] = $2 } END { for(k = 1; k <= 4; k++) print s[int((NR * k + 3) / 4)] }' $tmp/events | uniq | tr '\n' ' ')
+    measure
+    {
+	echo "$command"
+	echo "playouts $playouts"
+	echo "final_score $score"
+	printf "playouts_per_second %.1f\n" $best_rate
+	for t in $thresholds; do
+	    echo "time_to_score $t ${best_time[$t]}"
+	done
+    } > $test_file
+    [ -z "$quiet" ] && cat $test_file
+    exit 0
+fi
+
+base_playouts=$(awk '$1 == "playouts" { print $2 }' $test_file)
+base_score=$(awk '$1 == "final_score" { print $2 }' $test_file)
+base_rate=$(awk '$1 == "playouts_per_second" { print $2 }' $test_file)
+thresholds=$(awk '$1 == "time_to_score" { print $2 }' $test_file)
+
+read playouts seconds score <<< $(run_once)
+[ -z "$playouts" ] && exit 1
+res=0
+report () {
+    [ -z "$quiet" ] && echo "  $*"
+}
+
+if [ "$playouts" != "$base_playouts" ] || [ "$score" != "$base_score" ]; then
+    report "FAIL search changed: $playouts playouts, score $score (baseline: $base_playouts playouts, score $base_score), regenerate the baseline if this is expected"
+    res=1
+fi
+
+measure
+
+low=$(calc "$base_rate * (1 - $tolerance / 100)")
+line=$(printf "playouts_per_second %.1f (baseline %.1f, %+.1f%%)" $best_rate $base_rate $(calc "100 * ($best_rate / $base_rate - 1)"))
+if test_fp "$best_rate < $low"; then
+    report "FAIL $line"
+    res=1
+else
+    report "pass $line"
+fi
+
+for t in $thresholds; do
+    base_time=$(awk -v t=$t '$1 == "time_to_score" && $2 == t { print $3 }' $test_file)
+    tt=${best_time[$t]}
+    if [ -z "$tt" ]; then
+	report "FAIL time_to_score $t: not reached (baseline ${base_time}s)"
+	res=1
+	continue
+    fi
+    high=$(calc "$base_time * (1 + $tolerance / 100) + $slack")
+    line="time_to_score $t: ${tt}s (baseline ${base_time}s)"
+    if test_fp "$tt > $high"; then
+	report "FAIL $line"
+	res=1
+    else
+	report "pass $line"
+    fi
+done
+
+if [ $res -eq 0 ]; then
+    echo "$0: $test_file: SUCCESS."
+else
+    echo "$0: $test_file: FAILURE (tolerance $tolerance%)."
+fi
+exit $res
@@ -487,25 +487,34 @@ class Board {
     return feuillesOuvertes == 0;
   }
   
-  double score (int level = 2) {
-    double output;
+  /* Sum of the squared errors on training samples [begin, end) */
+  double squaredErrors (int begin, int end) {
     double target;
-								
-    float x=0;
-    double MSE=0;
-    int nbTests = inputs.size ();
-    if (level == 1)
-      nbTests = 100;
-    for(int i=0; i<nbTests; i++){
+    double SE=0;
+    for(int i=begin; i<end; i++){
       for (int j=0; j<nbVariables; j++)
         variableGP[j]=inputs[i][j];
       int depth = 0;
       double eval = evalStack (depth);
       target=targets[i];
-      MSE += powf((target - eval), 2);
-      //MSE += fabs(target - output);
-      //fprintf (stderr, "eval = %f, target = %f, MSE = %f\n", eval, target, MSE);
+      SE += powf((target - eval), 2);
+      //SE += fabs(target - output);
     }
+    return SE;
+  }
+
+  double score (int level = 2) {
+    int nbTests = inputs.size ();
+    if (level == 1)
+      nbTests = 100;
+    /* Samples are evaluated by chunks of 64 on idle threads, each
+       chunk uses its own copy of the board (variableGP). The partial
+       sums are added in order, so the score does not depend on the
+       number of idle threads */
+    double MSE = globalThreadPool ().parallelReduce (0, nbTests, 0.0, [this] (int b, int e) -> double {
+	Board board = *this;
+	return board.squaredErrors (b, e);
+      }, [] (double a, double b) { return a + b; }, 64);
     MSE/=nbTests;
     //fprintf (stderr, "MSE = %f\n", MSE);
 
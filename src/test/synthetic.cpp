@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+
+#include <nrpa.hpp>
+
+using namespace std;
+
+/* Synthetic domain to benchmark the engine without the noise of a real
+   game: every parameter of the workload is set on the command line,
+   after the nrpa options, as key=value:
+
+     length=N      moves per playout (default: 100)
+     moves=N       legal moves at each step (default: 2)
+     codes=N       size of the code space, 0 = length * moves (default: 0)
+     hashed=0|1    codes: 0 = dense (step * moves + move, modulo codes),
+                   1 = hashed from the step, the previous move and the
+                   move, scattered over the code space (default: 0)
+     step-cost=N   mixing rounds per legal move in legalMoves (default: 0)
+     score-cost=N  extra mixing rounds per move in score (default: 0)
+     seed=N        seed of the move values (default: 0)
+
+   e.g. ./synthetic -l 3 -n 10 length=50000 moves=5 hashed=1 (bus sized)
+        ./synthetic -l 3 -n 10 length=100 moves=112 codes=1000000 hashed=1 (same sized)
+
+   The score is the sum over the steps of a pseudo random integer in
+   [0,1000) of the step, the previous move and the move (scores are
+   stored as integers by Rollout::setScore). */
+
+class Synthetic {
+ public:
+  int length;
+  int moves;
+  long codes;
+  bool hashed;
+  int stepCost;
+  int scoreCost;
+  uint64_t seed;
+
+  Synthetic () {
+    length = 100;
+    moves = 2;
+    codes = 0;
+    hashed = false;
+    stepCost = 0;
+    scoreCost = 0;
+    seed = 0;
+  }
+
+  void parse (int argc, char *argv []) {
+    for (int i = 1; i < argc; i++) {
+      const char * eq = strchr (argv [i], '=');
+      if (eq == NULL) {
+	fprintf (stderr, "Error : unexpected argument %s (expected key=value).\n", argv [i]);
+	exit (1);
+      }
+      string key (argv [i], eq - argv [i]);
+      long value = atol (eq + 1);
+      if (key == "length") length = value;
+      else if (key == "moves") moves = value;
+      else if (key == "codes") codes = value;
+      else if (key == "hashed") hashed = value != 0;
+      else if (key == "step-cost") stepCost = value;
+      else if (key == "score-cost") scoreCost = value;
+      else if (key == "seed") seed = value;
+      else {
+	fprintf (stderr, "Error : unknown parameter %s.\n", key.c_str ());
+	exit (1);
+      }
+    }
+    if (codes == 0)
+      codes = (long)length * moves;
+    if (length < 1 || moves < 1 || codes < 1 || codes > INT32_MAX || stepCost < 0 || scoreCost < 0) {
+      fprintf (stderr, "Error : length, moves and codes should be positive, codes below 2^31, costs non negative.\n");
+      exit (1);
+    }
+  }
+
+  void print (FILE * fp) {
+    fprintf (fp, "Synthetic: length=%d moves=%d codes=%ld hashed=%d step-cost=%d score-cost=%d seed=%lu\n",
+	     length, moves, codes, hashed, stepCost, scoreCost, (unsigned long)seed);
+  }
+};
+
+Synthetic synthetic;
+
+/* keeps the rounds of step-cost from being optimized away */
+volatile uint64_t sink;
+
+static inline uint64_t mix (uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static inline uint64_t key (int step, int previous, int m) {
+  return synthetic.seed ^ (((uint64_t)step << 40) | ((uint64_t)(previous + 1) << 20) | (uint64_t)m);
+}
+
+typedef int Move;
+
+/* PL and LM bound the length and the moves of the playouts, see main */
+template <int PL, int LM>
+class Board {
+ public:
+  Move rollout [PL];
+  int length;
+
+  Board () {
+    length = 0;
+  }
+
+  int previous () {
+    return length > 0 ? rollout [length - 1] : -1;
+  }
+
+  int code (Move m) {
+    if (synthetic.hashed)
+      return mix (key (length, previous (), m)) % synthetic.codes;
+    return ((long)length * synthetic.moves + m) % synthetic.codes;
+  }
+
+  int legalMoves (Move moves [LM]) {
+    for (int i = 0; i < synthetic.moves; i++)
+      moves [i] = i;
+    if (synthetic.stepCost > 0) {
+      uint64_t h = length;
+      for (int i = 0; i < synthetic.moves; i++)
+	for (int k = 0; k < synthetic.stepCost; k++)
+	  h = mix (h + i);
+      sink = h;
+    }
+    return synthetic.moves;
+  }
+
+  void play (Move m) {
+    rollout [length] = m;
+    length++;
+  }
+
+  bool terminal () {
+    return length == synthetic.length;
+  }
+
+  double score () {
+    long sum = 0;
+    for (int step = 0; step < length; step++) {
+      uint64_t h = mix (key (step, step > 0 ? rollout [step - 1] : -1, rollout [step]));
+      for (int k = 0; k < synthetic.scoreCost; k++)
+	h = mix (h);
+      sum += h % 1000;
+    }
+    return (double)sum;
+  }
+
+  void print (FILE * fp) {
+    fprintf (fp, "length = %d, score = %.0f\n", length, score ());
+  }
+};
+
+/* Shapes of the boards: a playout of at most PL moves with at most LM
+   legal moves per step, the smallest shape that fits the parameters is
+   used (the legal move codes of a rollout take PL * LM ints). */
+template <int PL, int LM>
+bool run (Options & options) {
+  if (synthetic.length > PL || synthetic.moves > LM)
+    return false;
+  Nrpa<Board<PL, LM>, Move, 5, PL, LM>::test (options);
+  return true;
+}
+
+int main (int argc, char *argv []) {
+  Options options = Options::parse (argc, argv);
+  synthetic.parse (argc, argv);
+  synthetic.print (stdout);
+  if (run<1000, 128> (options) || run<50000, 8> (options))
+    exit (0);
+  fprintf (stderr, "Error : unsupported size, use length <= 1000 and moves <= 128, or length <= 50000 and moves <= 8.\n");
+  exit (1);
+}
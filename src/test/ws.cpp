@@ -29,8 +29,10 @@ class Board {
   int length;
   Move rollout [MaxPlayoutLength];
   bool policy;
+  Context *context;
 
   Board () {
+    context = &Context::current ();
     for (int i = 0; i < MaxPartition; i++) 
       sizePartition [i] = 0;
     for (int i = 0; i < MaxPartition; i++) 
@@ -41,6 +43,10 @@ class Board {
     policy = true;
   }
 
+  void setContext (Context *c) {
+    context = c;
+  }
+
   void print (FILE *fp) {
     if (false) {
       for (int i = 0; i < MaxPartition; i++) {
@@ -93,7 +99,7 @@ class Board {
               nbMoves++;
             }
           }
-    double proba = (double)(rand () / (RAND_MAX + 1.0));
+    double proba = context->uniform ();
     //fprintf (stderr, "%f,", proba);
     if ((nbMoves == 0) || (proba < epsilon))
       for (int i = 0; i < MaxPartition; i++) {
@@ -9,10 +9,22 @@
 #include <cassert> 
 #include <time.h>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <signal.h>
+#include <memory>
+#include <vector>
 
 //#define _GNU_SOURCE             /* See feature_test_macros(7) */
 #include <sched.h>
 
+#include "context.hpp"
+#include "trace.hpp"
+#include "perfcounters.hpp"
+
 
 using namespace std; 
 class ThreadPool{
@@ -22,7 +34,17 @@ class ThreadPool{
 
   atomic_bool _done; 
   queue< TaskHandler > _tasks; 
-  int _nbThreads; 
+  atomic<int> _nbThreads; // workers with a greater id are parked
+  int _nbStarted; // worker threads created, running or parked
+  unsigned int _seed; // base seed of the workers
+  atomic<int> _pendingSize; // requested number of threads, -1 if none
+  atomic<int> _nbBusy;   // workers running a task
+  atomic<int> _nbQueued; // tasks waiting in the queue
+  int _nbCalls; // parallel calls running, between enter() and leave()
+  atomic_bool _resized; 
+  mutex _resizeMutex; 
+  mutex _parkMutex; 
+  condition_variable _parked; 
   mutex _mutex;
   thread *_threads[MAX_THREADS]; 
   int _numTasks[MAX_THREADS] = {0}; 
@@ -35,10 +57,14 @@ class ThreadPool{
   bool _threadStats; 
 
 
-  inline void workerThread(int id) {
+  inline void workerThread(int id, unsigned int seed) {
     //    bindThread(id); 
+    Context::current().seed(seed); // do not share rand() with the other workers
+    Tracer::nameThread("worker " + to_string(id)); 
 
     while(!_done) {         
+      if(id >= max(1, (int)_nbThreads)){ park(id); continue; }
+
       FunctionType f; 
       promise<int> *p; 
       bool gotSomething = false; 
@@ -49,6 +75,8 @@ class ThreadPool{
 	p = _tasks.front().first;
 	f = _tasks.front().second;
 	_tasks.pop();
+	_nbBusy++; 
+	_nbQueued--; 
 	gotSomething = true; 
       }
       _mutex.unlock(); 
@@ -57,12 +85,18 @@ class ThreadPool{
 	clock::time_point start; 
 	if(_threadStats){ _numTasks[id]++; start = clock::now(); }
 
-	int ret = f();
+	int ret; 
+	PerfCounters::attachThread(); 
+	{
+	  Tracer::Scope scope("task", "pool"); 
+	  ret = f();
+	}
 	p->set_value( ret ) ; 
 	
 	if(_threadStats) _workTime[id] += clock::now() - start; 
 
 	delete p; 
+	_nbBusy--; 
       }
       else {
 	yield(); 
@@ -75,9 +109,72 @@ class ThreadPool{
     this_thread::yield();
   }
 
+  /* Workers above the size of the pool wait until it grows again.
+     Worker 0 is never parked, it runs the tasks submitted before a
+     resize to 0. */ 
+  inline void park(int id){
+    unique_lock<mutex> lk(_parkMutex); 
+    _parked.wait(lk, [this, id]{ return _done || id < max(1, (int)_nbThreads); }); 
+  }
+
+  inline void startThreads(int from, int to){
+    for(int i = from; i < to; i++){
+      if(_threadStats){ _workTime[i] = clock::duration::zero(); _numTasks[i] = 0; }
+      unsigned int seed = _seed ^ (0x9e3779b9u * (i + 1)); 
+      _threads[i] = new thread( [this, i, seed] { this->workerThread(i, seed); } );
+    }
+  }
+
+  /* Workers are never joined while parallel calls may be running:
+     the ones above the new size finish their task and park, and are
+     woken up when the pool grows again. */ 
+  inline void applyResize(int nbThreads){
+    int old = _nbThreads; 
+    if(nbThreads == old) return; 
+    cout<<"Resizing thread pool from "<<old<<" to "<<nbThreads<<" thread(s)."<<endl; 
+    if(nbThreads > _nbStarted){
+      startThreads(_nbStarted, nbThreads); 
+      _nbStarted = nbThreads; 
+    }
+    {
+      lock_guard<mutex> lk(_parkMutex); 
+      _nbThreads = nbThreads; 
+    }
+    _parked.notify_all(); 
+    _resized = true; 
+  }
+
+  /* Called with _resizeMutex held, nbOthers is the number of other
+     parallel calls running. Growth is applied at any time, a shrink
+     only when no other call is running: the tasks another call has
+     queued (e.g. the ones of a strategy that waits on a barrier) must
+     not lose the workers they were counted for. */ 
+  inline int applyPending(int nbOthers){
+    int size = _pendingSize; 
+    if(size >= 0 && (size > _nbThreads || nbOthers == 0)
+       && _pendingSize.compare_exchange_strong(size, -1))
+      applyResize(size); 
+    return _nbThreads; 
+  }
+
+  static inline ThreadPool *&signalPool(){
+    static ThreadPool *pool = nullptr; 
+    return pool; 
+  }
+
+  /* SIGUSR1 adds a worker thread, SIGUSR2 removes one */ 
+  static inline void signalHandler(int sig){
+    ThreadPool *pool = signalPool(); 
+    if(pool == nullptr) return; 
+    int size = pool->_pendingSize; 
+    if(size < 0) size = pool->_nbThreads; 
+    size += sig == SIGUSR1 ? 1 : -1; 
+    pool->_pendingSize = max(0, min(size, MAX_THREADS - 1)); 
+  }
+
 public:
   /* Done set to true initially, must call init() */ 
-  inline ThreadPool(): _done(true), _nbThreads(-1){}
+  inline ThreadPool(): _done(true), _nbThreads(-1), _nbStarted(0), _seed(1), _pendingSize(-1), _nbBusy(0), _nbQueued(0), _nbCalls(0), _resized(false){}
 
   inline ~ThreadPool(){
     end();
@@ -90,6 +187,7 @@ public:
     future<int> res = p->get_future(); 
     _mutex.lock(); 
     _tasks.push(make_pair(p, f));
+    _nbQueued++; 
     _mutex.unlock(); 
     return res;  
   }
@@ -99,19 +197,79 @@ public:
     _nbThreads = nbThreads; 
     _threadStats = threadStats; 
     _startTime = clock::now(); 
-    if(_threadStats){
-      fill_n(_workTime, _nbThreads, clock::duration::zero());
-      fill_n(_numTasks, _nbThreads, 0);
-    }
-
     cout<<"Initializing thread pool with "<<_nbThreads<<" thread(s)."<<endl; 
     _done = false; 
  
-    for(int i = 0; i < _nbThreads; i++){
-      _threads[i] = new thread( [this, i] { this->workerThread(i); } );
+    startThreads(0, _nbThreads); 
+    _nbStarted = _nbThreads; 
 
+    if(signalPool() == nullptr){
+      signalPool() = this; 
+      signal(SIGUSR1, signalHandler); 
+      signal(SIGUSR2, signalHandler); 
     }
+  }
 
+  /* Worker i draws from a stream derived from seed and i, so that
+     starting workers does not consume the rand() stream of the main
+     thread. Set before init() for the first workers. */ 
+  inline void seed(unsigned int seed){
+    _seed = seed; 
+  }
+
+  /* Number of cpus this process may run on: the size of its affinity
+     mask, bounded by the cgroup v2 cpu quota (cpu.max) if any. */ 
+  static inline int availableCpus(){
+    int nbCpus = thread::hardware_concurrency(); 
+    cpu_set_t set; 
+    if(sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0)
+      nbCpus = CPU_COUNT(&set); 
+
+    string path, line; 
+    ifstream cgroup("/proc/self/cgroup"); 
+    while(getline(cgroup, line))
+      if(line.compare(0, 3, "0::") == 0) path = line.substr(3); 
+    if(path == "/") path = ""; 
+
+    ifstream cpuMax("/sys/fs/cgroup" + path + "/cpu.max"); 
+    string quota; 
+    long period; 
+    if(cpuMax >> quota >> period && quota != "max" && period > 0){
+      long cpus = (stol(quota) + period - 1) / period; 
+      nbCpus = min<long>(nbCpus, max(1L, cpus)); 
+    }
+    return max(1, nbCpus); 
+  }
+
+  /* Ask for a new number of worker threads. This only records the
+     request (it can be called from a signal handler), the pool is
+     resized by the next enter() or poll(), see applyPending(). */ 
+  inline void resize(int nbThreads){
+    _pendingSize = max(0, min(nbThreads, MAX_THREADS - 1)); 
+  }
+
+  /* Parallel calls are made between enter() and leave(), enter()
+     returns the number of worker threads available for the call. */ 
+  inline int enter(){
+    lock_guard<mutex> lk(_resizeMutex); 
+    int nbThreads = applyPending(_nbCalls); 
+    _nbCalls++; 
+    return nbThreads; 
+  }
+
+  /* Same as enter() for the next round of tasks of a running call,
+     which has no task queued */ 
+  inline int poll(){
+    lock_guard<mutex> lk(_resizeMutex); 
+    return applyPending(_nbCalls - 1); 
+  }
+
+  /* True once the pool has been resized at runtime */ 
+  inline bool resized() const { return _resized; }
+
+  inline void leave(){
+    lock_guard<mutex> lk(_resizeMutex); 
+    _nbCalls--; 
   }
 
   inline bool initialized() const{
@@ -120,8 +278,13 @@ public:
 
   inline void end(){
     if(!_done) {
-      _done = true;
-      for(int i = 0; i < _nbThreads; i++){
+      {
+	lock_guard<mutex> lk(_parkMutex); 
+	_done = true;
+      }
+      _parked.notify_all(); 
+      if(signalPool() == this) signalPool() = nullptr; 
+      for(int i = 0; i < _nbStarted; i++){
 	_threads[i]->join(); 
 	delete _threads[i]; 
       }
@@ -149,6 +312,26 @@ public:
 
   inline int nbThreads() const { assert(_nbThreads != -1);  return _nbThreads; }
 
+  /* Worker threads neither running nor about to run a task */ 
+  inline int nbIdle() const {
+    return initialized() && !_done ? max(0, _nbThreads - _nbBusy - _nbQueued) : 0; 
+  }
+
+  /* Fork-join loops for domain code, e.g. an expensive Board::score().
+     [begin, end) is split in chunks of grain iterations (the last one
+     may be shorter), run by the calling thread and by the idle workers
+     of the pool. When no worker is idle (all busy with sub-searches, or
+     no pool), the chunks are run by the calling thread, in order. */ 
+  template <typename F>
+  void parallelFor(int begin, int end, F f, int grain = 1); // f(i)
+
+  /* f(b, e) computes the partial result of [b, e), partial results are
+     combined with reduce, in order, starting from init. The chunks do
+     not depend on the number of idle workers, neither does the result
+     (e.g. the rounding of a floating point sum). */ 
+  template <typename T, typename F, typename R>
+  T parallelReduce(int begin, int end, T init, F f, R reduce, int grain = 1); 
+
   inline void bindThread(int cpuId){
     cpu_set_t set;
     CPU_ZERO(&set); 
@@ -158,6 +341,106 @@ public:
 
 };
 
+/* Chunks of a parallelReduce. Helpers that start after the caller has
+   returned only see an empty counter, they keep the state alive. */ 
+template <typename T>
+struct ChunkState{
+  atomic<int> next; 
+  atomic<int> done; 
+  int nbChunks; 
+  vector<T> partials; 
+  function<T(int)> chunk; // only called for claimed chunks, while the caller waits
+
+  ChunkState(int nbChunks): next(0), done(0), nbChunks(nbChunks), partials(nbChunks){}
+
+  inline void work(){
+    int c; 
+    while((c = next++) < nbChunks){
+      partials[c] = chunk(c); 
+      done++; 
+    }
+  }
+}; 
+
+template <typename T, typename F, typename R>
+T ThreadPool::parallelReduce(int begin, int end, T init, F f, R reduce, int grain){
+  int n = end - begin; 
+  if(n <= 0) return init; 
+  grain = max(1, grain); 
+  int nbChunks = (n + grain - 1) / grain; 
+  int nbHelpers = min(nbIdle(), nbChunks - 1); 
+  auto chunk = [&f, begin, end, grain](int c) -> T {
+    long b = begin + (long)c * grain; 
+    return f(b, min<long>(end, b + grain)); 
+  }; 
+
+  if(nbHelpers == 0){
+    T result = init; 
+    for(int c = 0; c < nbChunks; c++)
+      result = reduce(result, chunk(c)); 
+    return result; 
+  }
+
+  shared_ptr<ChunkState<T>> state(new ChunkState<T>(nbChunks)); 
+  state->chunk = chunk; 
+  for(int i = 0; i < nbHelpers; i++)
+    submit([state]() -> int { state->work(); return 0; }); 
+  state->work(); 
+  {
+    Tracer::Scope scope("wait", "sync"); 
+    while(state->done < nbChunks) yield(); 
+  }
+
+  T result = init; 
+  for(int c = 0; c < nbChunks; c++)
+    result = reduce(result, state->partials[c]); 
+  return result; 
+}
+
+template <typename F>
+void ThreadPool::parallelFor(int begin, int end, F f, int grain){
+  parallelReduce(begin, end, 0, [&f](int b, int e) -> int {
+      for(int i = b; i < e; i++) f(i); 
+      return 0; 
+    }, [](int a, int) -> int { return a; }, grain); 
+}
+
+/* Pool shared by all Nrpa instances and by domain code */ 
+inline ThreadPool &globalThreadPool(){
+  static ThreadPool pool; 
+  return pool; 
+}
+
+/* Reusable barrier for a fixed number of threads. The last thread to
+   arrive runs the completion function, then all threads are released. */ 
+class Barrier{
+  mutex _mutex; 
+  condition_variable _cond; 
+  int _nbThreads; 
+  int _nbWaiting; 
+  unsigned _generation; 
+
+public:
+  inline Barrier(int nbThreads): _nbThreads(nbThreads), _nbWaiting(0), _generation(0){}
+
+  template <typename F>
+  inline void wait(F completion){
+    Tracer::Scope scope("barrier", "sync"); 
+    unique_lock<mutex> lk(_mutex); 
+    unsigned generation = _generation; 
+    if(++_nbWaiting == _nbThreads){
+      completion(); 
+      _nbWaiting = 0; 
+      _generation++; 
+      _cond.notify_all(); 
+    }
+    else
+      _cond.wait(lk, [this, generation]{ return generation != _generation; }); 
+  }
+
+  inline void wait(){ wait([]{}); }
+};
+
 #if 0
 int main(){
   ThreadPool t;
@@ -0,0 +1,192 @@
+// trace.hpp
+// Per-thread timeline of the search, dumped in the Chrome trace format.
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+
+/*
+ * Opt-in tracer (--trace=FILE). Each thread records its events in its
+ * own ring buffer, without any lock: the oldest events are overwritten
+ * when the buffer is full. When tracing is off, recording an event
+ * costs one relaxed load.
+ *
+ * dump() writes all the buffers as a Chrome trace (JSON), which can be
+ * opened with chrome://tracing or https://ui.perfetto.dev. It must be
+ * called when no thread records events (e.g. at the end of test()).
+ *
+ * Events have a static name and category, and an optional number
+ * (e.g. a level or a score):
+ *   { Tracer::Scope scope("round", "sync"); ... } // duration event
+ *   Tracer::instant("improvement", "search", score);
+ */
+class Tracer{
+
+public:
+
+  struct Event{
+    const char *name;
+    const char *cat;
+    char phase;        // 'X' = complete (with a duration), 'i' = instant
+    bool hasValue;
+    long long start;   // ns since start()
+    long long duration;
+    double value;
+  };
+
+  /* Events of one thread, only written by this thread */
+  struct Buffer{
+    Buffer(int tid): tid(tid), count(0){}
+    int tid;
+    std::string name;
+    std::vector<Event> events; // ring
+    size_t count;              // events recorded since start()
+  };
+
+  static inline Tracer &instance(){
+    static Tracer tracer;
+    return tracer;
+  }
+
+  static inline bool enabled(){
+    return instance()._enabled.load(std::memory_order_relaxed);
+  }
+
+  /* Start recording, at most capacity events are kept per thread */
+  inline void start(size_t capacity){
+    std::lock_guard<std::mutex> lk(_mutex);
+    _capacity = capacity;
+    _start = clock::now();
+    for(auto &b : _buffers){
+      b->count = 0;
+      b->events.assign(capacity, Event());
+    }
+    _enabled.store(true, std::memory_order_relaxed);
+  }
+
+  inline void stop(){
+    _enabled.store(false, std::memory_order_relaxed);
+  }
+
+  /* Name of the calling thread in the trace */
+  static inline void nameThread(const std::string &name){
+    local().name = name;
+  }
+
+  static inline long long now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - instance()._start).count();
+  }
+
+  static inline void instant(const char *name, const char *cat){
+    if(enabled()) record(name, cat, 'i', now(), 0, false, 0);
+  }
+
+  static inline void instant(const char *name, const char *cat, double value){
+    if(enabled()) record(name, cat, 'i', now(), 0, true, value);
+  }
+
+  /* Duration event from the construction to the destruction of the scope */
+  class Scope{
+  public:
+    inline Scope(const char *name, const char *cat): _name(name), _cat(cat), _hasValue(false), _value(0){
+      _start = enabled() ? now() : -1;
+    }
+    inline Scope(const char *name, const char *cat, double value): _name(name), _cat(cat), _hasValue(true), _value(value){
+      _start = enabled() ? now() : -1;
+    }
+    inline ~Scope(){
+      if(_start >= 0 && enabled()) record(_name, _cat, 'X', _start, now() - _start, _hasValue, _value);
+    }
+  private:
+    const char *_name;
+    const char *_cat;
+    bool _hasValue;
+    double _value;
+    long long _start;
+  };
+
+  /* Write the events of all threads to filename, returns false on error */
+  inline bool dump(const std::string &filename){
+    std::ofstream ofs(filename);
+    if(!ofs) return false;
+    std::lock_guard<std::mutex> lk(_mutex);
+    char buf[512];
+    ofs<<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t nbLost = 0;
+    for(auto &b : _buffers){
+      std::string name = b->name.empty() ? "thread " + std::to_string(b->tid) : b->name;
+      snprintf(buf, sizeof(buf), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+	       b->tid, name.c_str());
+      ofs<<(first ? "" : ",\n")<<buf;
+      first = false;
+
+      size_t n = std::min(b->count, b->events.size());
+      if(b->count > n) nbLost += b->count - n;
+      for(size_t k = b->count - n; k < b->count; k++){
+	const Event &e = b->events[k % b->events.size()];
+	int len = snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+			   e.name, e.cat, e.phase, b->tid, e.start / 1000.);
+	if(e.phase == 'X')
+	  len += snprintf(buf + len, sizeof(buf) - len, ",\"dur\":%.3f", e.duration / 1000.);
+	else
+	  len += snprintf(buf + len, sizeof(buf) - len, ",\"s\":\"t\"");
+	if(e.hasValue)
+	  len += snprintf(buf + len, sizeof(buf) - len, ",\"args\":{\"value\":%.17g}", e.value);
+	snprintf(buf + len, sizeof(buf) - len, "}");
+	ofs<<",\n"<<buf;
+      }
+    }
+    ofs<<"\n]}\n";
+    if(nbLost > 0)
+      std::cerr<<"Warning : "<<nbLost<<" trace event(s) overwritten, use a larger --trace-size."<<std::endl;
+    return (bool)ofs;
+  }
+
+private:
+
+  typedef std::chrono::steady_clock clock;
+
+  Tracer(): _enabled(false), _capacity(0), _start(clock::now()){}
+  Tracer(const Tracer &) = delete;
+
+  static inline Buffer &local(){
+    static thread_local std::shared_ptr<Buffer> buffer = instance().registerThread();
+    return *buffer;
+  }
+
+  inline std::shared_ptr<Buffer> registerThread(){
+    std::lock_guard<std::mutex> lk(_mutex);
+    std::shared_ptr<Buffer> buffer(new Buffer(_buffers.size()));
+    buffer->events.assign(_capacity, Event());
+    _buffers.push_back(buffer);
+    return buffer;
+  }
+
+  static inline void record(const char *name, const char *cat, char phase, long long start,
+			    long long duration, bool hasValue, double value){
+    Buffer &b = local();
+    if(b.events.empty()) return;
+    Event &e = b.events[b.count % b.events.size()];
+    e.name = name; e.cat = cat; e.phase = phase; e.hasValue = hasValue;
+    e.start = start; e.duration = duration; e.value = value;
+    b.count++;
+  }
+
+  std::atomic<bool> _enabled;
+  size_t _capacity;
+  clock::time_point _start;
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<Buffer>> _buffers;
+};
+
+#endif //TRACE_HPP